@@ -0,0 +1,86 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include "grid.h"
+#include "paint.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+using std::cout;
+using std::setw;
+using std::string;
+
+
+// Time one call in milliseconds.
+template<typename F>
+double
+time_ms(F f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// Best of several runs, for short operations.
+template<typename F>
+double
+best_ms(int runs, F f)
+{
+    double best = time_ms(f);
+    for (int i = 1; i < runs; i++)
+        best = std::min(best, time_ms(f));
+    return best;
+}
+
+inline size_t
+resident_bytes()
+{
+    size_t pages = 0, resident = 0;
+    std::ifstream("/proc/self/statm") >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+inline void
+report(string what, double value, string unit)
+{
+    cout << std::left << setw(32) << what << std::right << std::fixed
+         << std::setprecision(2) << setw(12) << value << ' ' << unit << '\n';
+}
+
+inline void
+report(string what, size_t count)
+{
+    cout << std::left << setw(32) << what << std::right
+         << setw(9) << count << '\n';
+}
+
+
+// The grid part of DemoLevel::generate(), which is the reference workload.
+inline void
+demo_terrain(Grid& grid, int size = 256)
+{
+    using namespace paint;
+
+    grid = Grid(size);
+
+    auto v = View(grid);
+    v.fill(Tile{}.color({15, 10, 0}));
+
+    v = v.center().clip_up();
+    v.cut();
+    rolling_hills_smooth(
+        v.translate(ivec3(0, 7, 0)).
+            rotate(irot::flip_y()).clip_up().rotate(irot::flip_y()).base(),
+        Tile{}.color({0, 24, 15}));
+    trees(v, 1);
+}
+
+
+#endif
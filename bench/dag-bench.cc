@@ -0,0 +1,26 @@
+// Memory saved by sharing identical subtrees.
+
+#include "bench.h"
+
+
+void
+measure(string name, int size)
+{
+    Grid grid;
+    demo_terrain(grid, size);
+    size_t before = BranchPool::stats().branches;
+    report(name + " branches", before);
+    report(name + " deduplicate", time_ms([&] { grid.deduplicate(); }), "ms");
+    size_t after = BranchPool::stats().branches;
+    report(name + " shared branches", after);
+    report(name + " saved", (before - after) * sizeof(Branch) / 1048576.,
+           "MiB");
+    report(name + " ratio", double(before) / after, "x");
+}
+
+int
+main()
+{
+    measure("demo", 256);
+    measure("stress", 1024);
+}
@@ -0,0 +1,65 @@
+// Cursor::fill() against the recursive reference implementation.
+
+#include "bench.h"
+
+#include <random>
+#include <vector>
+
+using std::vector;
+
+
+struct Edit {
+    Box b;
+    Tile t;
+};
+
+static void
+compare(string what, int size, const vector<Edit>& edits)
+{
+    Grid grid;
+    double reference = best_ms(3, [&] {
+        grid = Grid(size);
+        for (auto& e: edits)
+            grid.top().fill_reference(e.b, e.t);
+    });
+    double fill = best_ms(3, [&] {
+        grid = Grid(size);
+        for (auto& e: edits)
+            grid.top().fill(e.b, e.t);
+    });
+    report(what + " reference", reference, "ms");
+    report(what + " fill", fill, "ms");
+}
+
+
+int
+main()
+{
+    std::mt19937 random;
+    auto coord = [&] (int n) { return int(random() % n); };
+
+    const int size = 256;
+    Tile tiles[] = { Tile{}, Tile{}.color({31, 0, 0}), Tile::empty() };
+
+    vector<Edit> small, large;
+    for (int i = 0; i < 100000; i++) {
+        ivec3 p(coord(size), coord(size), coord(size));
+        small.push_back({ p + Box{ivec3(1 + coord(8))}, tiles[coord(3)] });
+    }
+    for (int i = 0; i < 1000; i++) {
+        ivec3 p(coord(size), coord(size), coord(size));
+        large.push_back({ p + Box{ivec3(1 + coord(size/2))}, tiles[coord(3)] });
+    }
+    compare("random small", size, small);
+    compare("random large", size, large);
+
+    // replay the demo terrain one column at a time, like paint::heightmap
+    Grid demo;
+    demo_terrain(demo, size);
+    vector<Edit> columns;
+    demo.ctop().each_tile(SBox{size}, [&] (SBox s, Tile t) {
+        for (auto u: Box{s}.boxes_y())
+            columns.push_back({ u, t });
+    });
+    compare("demo columns", size, columns);
+}
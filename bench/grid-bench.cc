@@ -0,0 +1,85 @@
+// Build, traversal and memory cost of the demo terrain.
+
+#include "bench.h"
+#include "packed.h"
+
+#include <pgamecc.h>
+
+#include <vector>
+
+using std::vector;
+namespace entropy = pgamecc::entropy;
+
+
+int
+main()
+{
+    size_t rss0 = resident_bytes();
+
+    Grid grid;
+    report("build", time_ms([&] { demo_terrain(grid); }), "ms");
+
+    auto pool = BranchPool::stats();
+    report("branches", pool.branches);
+    report("pool slabs", pool.bytes / 1048576., "MiB");
+    report("resident growth", (resident_bytes() - rss0) / 1048576., "MiB");
+
+    GridStats stats;
+    report("stats", time_ms([&] { stats = grid.stats(); }), "ms");
+    report("grid branches", stats.branches);
+    report("grid leaves", stats.leaves());
+    report("shaped leaves", stats.shaped);
+    report("grid bytes", stats.bytes() / 1048576., "MiB");
+    report("merge ratio", stats.merge_ratio(), "cells/leaf");
+
+    size_t tiles = 0;
+    report("each_tile", best_ms(5, [&] {
+        tiles = 0;
+        grid.ctop().each_tile(SBox{grid.size()}, [&] (SBox, Tile) {
+            tiles++;
+        });
+    }), "ms");
+    report("tiles", tiles);
+
+    const int lookups = 1000000;
+    vector<SBox> points;
+    for (int i = 0; i < lookups; i++)
+        points.push_back(SBox{1} + ivec3(entropy::dice(grid.size()),
+                                         entropy::dice(grid.size()),
+                                         entropy::dice(grid.size())));
+    int found = 0;
+    report("find_smallest x1M", best_ms(5, [&] {
+        found = 0;
+        for (auto p: points)
+            found += grid.ctop().find_smallest(p).is_tile();
+    }), "ms");
+
+    // the same traversals over a packed copy
+    PackedGrid packed;
+    report("pack", time_ms([&] { packed = PackedGrid(grid); }), "ms");
+    report("packed size", packed.bytes() / 1048576., "MiB");
+
+    report("packed each_tile", best_ms(5, [&] {
+        tiles = 0;
+        packed.ctop().each_tile(SBox{packed.size()}, [&] (SBox, Tile) {
+            tiles++;
+        });
+    }), "ms");
+
+    report("packed find_smallest x1M", best_ms(5, [&] {
+        found = 0;
+        for (auto p: points)
+            found += packed.ctop().find_smallest(p).is_tile();
+    }), "ms");
+
+    // repack after a small edit, as done once per frame
+    Box dirty = SBox{4} + ivec3(grid.size() / 2);
+    report("packed update", best_ms(5, [&] {
+        grid.top().fill(dirty, Tile{});
+        packed.update(grid, dirty);
+        grid.top().cut(dirty);
+        packed.update(grid, dirty);
+    }), "ms");
+
+    report("teardown", time_ms([&] { grid = Grid(); }), "ms");
+}
@@ -0,0 +1,59 @@
+// Rolling hills heightmaps from 256^2 to 4096^2: the single-threaded
+// reference, and the chunked version on one thread and on all cores. All
+// must give the same heights.
+
+#include "bench.h"
+
+#include <thread>
+
+
+static bool
+same(pgamecc::Image<int>& a, pgamecc::Image<int>& b, int size)
+{
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            pgamecc::ivec2 p(x, y);
+            if (a[p] != b[p]) {
+                cout << "heights differ at " << x << ", " << y << '\n';
+                return false;
+            }
+        }
+    return true;
+}
+
+int
+main()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    report("cores", size_t(cores));
+
+    for (int size: { 256, 1024, 4096 }) {
+        string s = std::to_string(size);
+        pgamecc::ivec2 dims(size);
+        int height = size / 4;
+
+        auto t0 = std::chrono::steady_clock::now();
+        auto reference = paint::rolling_hills_heightmap_reference(dims, height);
+        auto t1 = std::chrono::steady_clock::now();
+        double r = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        report("heightmap " + s + " reference", r, "ms");
+
+        split_threads = 1;
+        t0 = std::chrono::steady_clock::now();
+        auto serial = paint::rolling_hills_heightmap(dims, height);
+        t1 = std::chrono::steady_clock::now();
+        double one = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        report("heightmap " + s + " 1 thread", one, "ms");
+
+        split_threads = 0;
+        t0 = std::chrono::steady_clock::now();
+        auto parallel = paint::rolling_hills_heightmap(dims, height);
+        t1 = std::chrono::steady_clock::now();
+        double all = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        report("heightmap " + s + " all threads", all, "ms");
+        report("speedup " + s, r / all, "x");
+
+        if (!same(reference, serial, size) || !same(reference, parallel, size))
+            return 1;
+    }
+}
@@ -0,0 +1,66 @@
+// coord_less via Morton keys against the original bit-by-bit loop.
+
+#include "bench.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+using std::map;
+using std::vector;
+
+
+// the original comparator, see misc/coord_less.cc
+static bool
+loop_less(ivec3 a, ivec3 b)
+{
+    int i = 0, j = 0;
+    for (int d = 1;; d <<= 1) {
+        if (a == b)
+            return i < j;
+        i = ioct(a.x & d, a.y & d, a.z & d).i();
+        j = ioct(b.x & d, b.y & d, b.z & d).i();
+        a = ivec3(a.x & ~d, a.y & ~d, a.z & ~d),
+        b = ivec3(b.x & ~d, b.y & ~d, b.z & ~d);
+    }
+}
+
+struct LoopLess {
+    bool operator()(ivec3 a, ivec3 b) const { return loop_less(a, b); }
+};
+
+template<typename Less>
+static void
+run(string what, const vector<ivec3>& coords)
+{
+    report(what + " sort", best_ms(3, [&] {
+        auto v = coords;
+        std::sort(v.begin(), v.end(), Less());
+    }), "ms");
+
+    map<ivec3, int, Less> m;
+    report(what + " map insert", time_ms([&] {
+        for (auto c: coords)
+            m.emplace(c, 0);
+    }), "ms");
+    size_t found = 0;
+    report(what + " map find", time_ms([&] {
+        for (auto c: coords)
+            found += m.count(c);
+    }), "ms");
+    assert(found == coords.size());
+}
+
+
+int
+main()
+{
+    std::mt19937 random;
+    vector<ivec3> coords;
+    for (int i = 0; i < 1000000; i++)
+        coords.emplace_back(random() % 256, random() % 256, random() % 256);
+
+    run<LoopLess>("loop", coords);
+    run<Grid::cursor::CoordLess>("morton", coords);
+}
@@ -0,0 +1,28 @@
+// Demo terrain generation with the painters split over one thread and over
+// all cores, at the demo size and at 1024^3.
+
+#include "bench.h"
+
+#include <thread>
+
+
+int
+main()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    report("cores", size_t(cores));
+
+    for (int size: { 256, 1024 }) {
+        string s = std::to_string(size);
+        Grid grid;
+
+        split_threads = 1;
+        double serial = time_ms([&] { demo_terrain(grid, size); });
+        report("generate " + s + " 1 thread", serial, "ms");
+
+        split_threads = 0;
+        double parallel = time_ms([&] { demo_terrain(grid, size); });
+        report("generate " + s + " all threads", parallel, "ms");
+        report("speedup " + s, serial / parallel, "x");
+    }
+}
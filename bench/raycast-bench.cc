@@ -0,0 +1,56 @@
+// Thruster-like ray bundles over the demo terrain, one ray at a time and as
+// packets.
+
+#include "bench.h"
+
+#include <pgamecc.h>
+
+#include <vector>
+
+using std::vector;
+namespace entropy = pgamecc::entropy;
+
+
+int
+main()
+{
+    Grid grid;
+    demo_terrain(grid);
+
+    // 37 rays on a disk of radius 3 pointing down, as on a craft
+    const int bundles = 10000;
+    dvec3 down(0, -1, 0);
+    vector<dvec3> disk;
+    for (int i = 0; i < 37; i++) {
+        double a = 2 * glm::pi<double>() * ((i+11)%12) / 12;
+        double r = 3. * ((i+11)/12);
+        disk.emplace_back(r * sin(a), 0, r * cos(a));
+    }
+    vector<dvec3> centers;
+    for (int i = 0; i < bundles; i++)
+        centers.emplace_back(entropy::dice(grid.size() - 8) + 4,
+                             grid.size() / 2 + 10 + entropy::dice(10),
+                             entropy::dice(grid.size() - 8) + 4);
+
+    int hits = 0;
+    report("single x37 x10k", best_ms(3, [&] {
+        hits = 0;
+        for (auto c: centers)
+            for (auto p: disk)
+                hits += bool(grid.raycast(c + p, down, 10));
+    }), "ms");
+    report("hits", hits);
+
+    report("packet x10k", best_ms(3, [&] {
+        hits = 0;
+        for (auto c: centers) {
+            RayPacket packet(down, 10);
+            for (auto p: disk)
+                packet.add(c + p);
+            grid.raycast(packet);
+            for (int i = 0; i < packet.size(); i++)
+                hits += bool(packet[i]);
+        }
+    }), "ms");
+    report("hits", hits);
+}
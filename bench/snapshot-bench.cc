@@ -0,0 +1,44 @@
+// Loading the demo terrain from a snapshot compared with generating it.
+
+#include "bench.h"
+#include "packed.h"
+#include "snapshot.h"
+
+#include <cstdio>
+
+
+int
+main()
+{
+    const char* path = "snapshot-bench.grid";
+    uint64_t key = GridSnapshot::key("snapshot-bench");
+
+    Grid grid;
+    report("generate", time_ms([&] { demo_terrain(grid); }), "ms");
+
+    PackedGrid packed;
+    report("pack", time_ms([&] { packed = PackedGrid(grid); }), "ms");
+    report("save", time_ms([&] {
+        GridSnapshot::save(path, packed, key);
+    }), "ms");
+    report("snapshot size", packed.bytes() / 1048576., "MiB");
+
+    // the file is likely in the page cache, so this is the best case
+    report("open", best_ms(5, [&] { GridSnapshot s(path, key); }), "ms");
+
+    GridSnapshot snapshot(path, key);
+    size_t tiles = 0;
+    report("each_tile in place", best_ms(5, [&] {
+        tiles = 0;
+        snapshot.ctop().each_tile(SBox{snapshot.size()}, [&] (SBox, Tile) {
+            tiles++;
+        });
+    }), "ms");
+    report("tiles", tiles);
+
+    report("open and unpack", best_ms(5, [&] {
+        grid = GridSnapshot(path, key).unpack();
+    }), "ms");
+
+    std::remove(path);
+}
@@ -0,0 +1,48 @@
+// Tile visitation over the demo terrain with an inlined callback, through
+// std::function as before, and with the tile range.
+
+#include "bench.h"
+
+#include <functional>
+
+
+int
+main()
+{
+    Grid grid;
+    demo_terrain(grid);
+    SBox all{grid.size()};
+
+    size_t tiles = 0;
+    report("each_tile template", best_ms(5, [&] {
+        tiles = 0;
+        grid.ctop().each_tile(all, [&] (SBox, Tile) { tiles++; });
+    }), "ms");
+    report("tiles", tiles);
+
+    std::function<void(SBox, Tile)> callback = [&] (SBox, Tile) { tiles++; };
+    report("each_tile std::function", best_ms(5, [&] {
+        tiles = 0;
+        grid.ctop().each_tile(all, callback);
+    }), "ms");
+
+    report("tiles() range", best_ms(5, [&] {
+        tiles = 0;
+        for (auto st: grid.ctop().tiles(all)) {
+            (void)st;
+            tiles++;
+        }
+    }), "ms");
+
+    // a small bound, as for an island
+    Box small = SBox{16} + ivec3(grid.size() / 2);
+    report("each_tile 16^3 x1000", best_ms(5, [&] {
+        for (int i = 0; i < 1000; i++)
+            grid.ctop().each_tile(small, [&] (SBox, Tile) { tiles++; });
+    }), "ms");
+    report("View::each_tile 16^3 x1000", best_ms(5, [&] {
+        View v = View(grid).clip(small);
+        for (int i = 0; i < 1000; i++)
+            v.each_tile([&] (SBox, Tile) { tiles++; });
+    }), "ms");
+}
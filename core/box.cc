@@ -13,6 +13,237 @@ Box::sbox() const {
 }
 
 
+
+//
+// BoxSet
+//
+
+void
+BoxSet::push(Box b)
+{
+    ivec3 p0 = b.p0(), p1 = b.p1();
+    for (int a = 0; a < 3; a++) {
+        c[a].push_back(p0[a]);
+        c[a + 3].push_back(p1[a]);
+    }
+}
+
+void
+BoxSet::erase(size_t i)
+{
+    for (auto& a: c) {
+        a[i] = a.back();
+        a.pop_back();
+    }
+}
+
+// Each box that b overlaps is replaced by what is left of it, in at most six
+// slabs: the parts outside b along x, then along y within b's range of x, then
+// along z within b's range of x and y.
+void
+BoxSet::cut(Box b)
+{
+    for (size_t i = size(); i-- > 0;) {
+        Box r = (*this)[i];
+        if (!r.intersects(b))
+            continue;
+        erase(i); // the box moved here was looked at already or is new
+        Box m = r & b;
+        ivec3 lo = r.p0(), hi = r.p1();
+        for (int a = 0; a < 3; a++) {
+            if (lo[a] < m.p0()[a]) {
+                ivec3 h = hi;
+                h[a] = m.p0()[a];
+                push(Box::ranged(lo, h));
+            }
+            if (m.p1()[a] < hi[a]) {
+                ivec3 l = lo;
+                l[a] = m.p1()[a];
+                push(Box::ranged(l, hi));
+            }
+            lo[a] = m.p0()[a];
+            hi[a] = m.p1()[a];
+        }
+    }
+}
+
+
+long
+BoxSet::volume() const
+{
+    long v = 0;
+    for (size_t i = 0; i < size(); i++)
+        v += long(c[3][i] - c[0][i]) * (c[4][i] - c[1][i]) *
+             (c[5][i] - c[2][i]);
+    return v;
+}
+
+Box
+BoxSet::bound() const
+{
+    if (empty())
+        return Box{ivec3(0)};
+    ivec3 p0 = (*this)[0].p0(), p1 = (*this)[0].p1();
+    for (int a = 0; a < 3; a++) {
+        p0[a] = *std::min_element(c[a].begin(), c[a].end());
+        p1[a] = *std::max_element(c[a + 3].begin(), c[a + 3].end());
+    }
+    return Box::ranged(p0, p1);
+}
+
+
+// Queries go over all boxes without branching, so that they vectorize.
+
+bool
+BoxSet::intersects(Box b) const
+{
+    const int *x0 = c[0].data(), *y0 = c[1].data(), *z0 = c[2].data(),
+              *x1 = c[3].data(), *y1 = c[4].data(), *z1 = c[5].data();
+    int any = 0;
+    for (size_t i = 0; i < size(); i++)
+        any |= (x1[i] > b.x0()) & (x0[i] < b.x1()) &
+               (y1[i] > b.y0()) & (y0[i] < b.y1()) &
+               (z1[i] > b.z0()) & (z0[i] < b.z1());
+    return any;
+}
+
+bool
+BoxSet::contains(Box b) const
+{
+    // the boxes are disjoint, so their overlaps with b add up to b if they
+    // cover it
+    const int *x0 = c[0].data(), *y0 = c[1].data(), *z0 = c[2].data(),
+              *x1 = c[3].data(), *y1 = c[4].data(), *z1 = c[5].data();
+    long v = 0;
+    for (size_t i = 0; i < size(); i++) {
+        int dx = max(0, min(x1[i], b.x1()) - max(x0[i], b.x0())),
+            dy = max(0, min(y1[i], b.y1()) - max(y0[i], b.y0())),
+            dz = max(0, min(z1[i], b.z1()) - max(z0[i], b.z0()));
+        v += long(dx) * dy * dz;
+    }
+    ivec3 d = b.size();
+    return v == long(d.x) * d.y * d.z;
+}
+
+
+BoxSet&
+BoxSet::operator|=(Box b)
+{
+    if (!b.empty()) {
+        cut(b);
+        push(b);
+        coalesce(size() - 1);
+    }
+    return *this;
+}
+
+BoxSet&
+BoxSet::operator-=(Box b)
+{
+    cut(b);
+    coalesce();
+    return *this;
+}
+
+BoxSet&
+BoxSet::operator&=(Box b)
+{
+    for (size_t i = size(); i-- > 0;) {
+        Box r = (*this)[i] & b;
+        erase(i);
+        if (!r.empty())
+            push(r);
+    }
+    coalesce();
+    return *this;
+}
+
+BoxSet&
+BoxSet::operator|=(const BoxSet& r)
+{
+    for (size_t j = 0; j < r.size(); j++) {
+        cut(r[j]);
+        push(r[j]);
+    }
+    coalesce();
+    return *this;
+}
+
+BoxSet&
+BoxSet::operator-=(const BoxSet& r)
+{
+    for (size_t j = 0; j < r.size(); j++)
+        cut(r[j]);
+    coalesce();
+    return *this;
+}
+
+BoxSet&
+BoxSet::operator&=(const BoxSet& r)
+{
+    BoxSet result;
+    for (size_t i = 0; i < size(); i++)
+        for (size_t j = 0; j < r.size(); j++) {
+            Box m = (*this)[i] & r[j];
+            if (!m.empty())
+                result.push(m);
+        }
+    result.coalesce();
+    return *this = std::move(result);
+}
+
+
+// Two boxes join along axis a if one ends where the other begins and they
+// span the same range on both other axes.
+bool
+BoxSet::joins(size_t i, size_t j, int a) const
+{
+    for (int o = 0; o < 3; o++)
+        if (o != a && (c[o][i] != c[o][j] || c[o + 3][i] != c[o + 3][j]))
+            return false;
+    return c[a + 3][i] == c[a][j] || c[a + 3][j] == c[a][i];
+}
+
+void
+BoxSet::coalesce()
+{
+    for (bool joined = true; joined;) {
+        joined = false;
+        for (size_t i = 0; i < size(); i++)
+            for (size_t j = i + 1; j < size(); j++)
+                for (int a = 0; a < 3; a++)
+                    if (joins(i, j, a)) {
+                        c[a][i] = min(c[a][i], c[a][j]);
+                        c[a + 3][i] = max(c[a + 3][i], c[a + 3][j]);
+                        erase(j--); // look at the box moved to j
+                        joined = true;
+                        break;
+                    }
+    }
+}
+
+// What box i grows into can join others in turn, so the others are gone over
+// again until none joins.
+void
+BoxSet::coalesce(size_t i)
+{
+    for (bool joined = true; joined;) {
+        joined = false;
+        for (size_t j = 0; j < size() && !joined; j++)
+            for (int a = 0; a < 3 && j != i; a++)
+                if (joins(i, j, a)) {
+                    c[a][i] = min(c[a][i], c[a][j]);
+                    c[a + 3][i] = max(c[a + 3][i], c[a + 3][j]);
+                    if (i == size() - 1)
+                        i = j; // erase() moves it there
+                    erase(j);
+                    joined = true;
+                    break;
+                }
+    }
+}
+
+
 #ifndef NDEBUG
 
 bool
@@ -147,4 +378,13 @@ Box::show_oblique(const list<Box>& boxes, int extent, bool axes) {
     }
 }
 
+ostream&
+operator<<(ostream& s, const BoxSet& r)
+{
+    s << "BoxSet{";
+    for (size_t i = 0; i < r.size(); i++)
+        s << (i ? ", " : "") << r[i];
+    return s << "}";
+}
+
 #endif
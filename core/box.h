@@ -7,6 +7,7 @@
 #include <cstdlib> // abs
 #include <iostream>
 #include <list>
+#include <vector>
 
 #include <glm/ext.hpp>
 
@@ -15,6 +16,7 @@ using std::max;
 using std::min;
 using std::abs;
 using std::swap;
+using std::vector;
 using pgamecc::ivec3;
 using pgamecc::dvec3;
 using pgamecc::irot;
@@ -319,4 +321,77 @@ public:
 #endif
 };
 
+
+// A region made of disjoint boxes, such as what changed in a grid or what a
+// group of sprites covers, without the empty space a hull of them would have.
+// Coordinates are kept per axis in separate arrays, so that a query goes over
+// them in simple loops the compiler can vectorize.
+
+class BoxSet {
+    vector<int> c[6]; // x0, y0, z0, x1, y1, z1 of each box
+
+    void push(Box);
+    void erase(size_t i); // moves the last box to i
+    void cut(Box); // remove b from boxes, not looking for new neighbours
+    bool joins(size_t i, size_t j, int a) const;
+    void coalesce(size_t i); // join box i with its neighbours
+
+public:
+    BoxSet() {}
+    BoxSet(Box b) { *this |= b; }
+
+    size_t size() const { return c[0].size(); }
+    bool empty() const { return !size(); }
+    void clear() { for (auto& a: c) a.clear(); }
+
+    Box operator[](size_t i) const {
+        return Box::ranged(ivec3(c[0][i], c[1][i], c[2][i]),
+                           ivec3(c[3][i], c[4][i], c[5][i]));
+    }
+
+    template<typename F>
+    void each(F&& f) const {
+        for (size_t i = 0; i < size(); i++)
+            f((*this)[i]);
+    }
+
+    // properties
+
+    long volume() const;
+    Box bound() const; // hull, empty if the set is
+
+    // queries
+
+    bool intersects(Box) const;
+    bool contains(Box) const;
+    bool contains(ivec3 p) const { return contains(p + Box{ivec3(1)}); }
+
+    // combinations, which keep the boxes disjoint and join boxes that make
+    // up a larger one where they can; adding one box only joins it with its
+    // neighbours, and leaves what it cut from others as it is
+
+    BoxSet& operator|=(Box);
+    BoxSet& operator-=(Box);
+    BoxSet& operator&=(Box);
+    BoxSet& operator|=(const BoxSet&);
+    BoxSet& operator-=(const BoxSet&);
+    BoxSet& operator&=(const BoxSet&);
+
+    BoxSet operator|(const BoxSet& r) const { return BoxSet(*this) |= r; }
+    BoxSet operator-(const BoxSet& r) const { return BoxSet(*this) -= r; }
+    BoxSet operator&(const BoxSet& r) const { return BoxSet(*this) &= r; }
+
+    // Union with b without joining anything, for adding many boxes and then
+    // calling coalesce() once, rather than joining after each.
+    void add(Box b) { if (!b.empty()) { cut(b); push(b); } }
+
+    // Join pairs of boxes that share a whole face, until there are none. Done
+    // by the combinations; only needed after changing boxes some other way.
+    void coalesce();
+
+#ifndef NDEBUG
+    friend ostream& operator<<(ostream&, const BoxSet&);
+#endif
+};
+
 #endif
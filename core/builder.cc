@@ -0,0 +1,113 @@
+#include "builder.h"
+
+#include <cassert>
+#include <memory>
+#include <utility>
+
+using std::unique_ptr;
+
+
+GridBuilder::GridBuilder(int size, Tile background) :
+    levels(0), next(0), background(background)
+{
+    assert(size > 0 && (size & size - 1) == 0);
+    while (1 << levels < size)
+        levels++;
+    assert(levels <= Morton::bits);
+}
+
+
+// Put down a node covering 8^level cells at next, completing octets upwards.
+void
+GridBuilder::emit(Node n, int level)
+{
+    uint64_t at = next;
+    next += uint64_t(1) << 3 * level;
+    for (; level < levels; level++) {
+        int i = at >> 3 * level & 7;
+        pending[level][i] = std::move(n);
+        if (i < 7)
+            return;
+
+        // merged as apply() does: equal tiles, unless shaped
+        Node* octet = pending[level];
+        bool same = octet[0].is_tile() &&
+                    (!octet[0].tile() || !octet[0].tile().shape());
+        for (int j = 1; same && j < 8; j++)
+            same = octet[j] == octet[0];
+        if (same)
+            n = octet[0].tile();
+        else {
+            unique_ptr<Branch> b(new Branch());
+            for (auto j: ioct::all())
+                (*b)[j] = std::move(octet[j.i()]);
+            b->summarize();
+            n = std::move(b);
+        }
+    }
+    root = std::move(n);
+}
+
+// in the largest aligned blocks that fit
+void
+GridBuilder::skip_to(uint64_t key)
+{
+    while (next < key) {
+        int level = 0;
+        while (level < levels) {
+            uint64_t up = uint64_t(8) << 3 * level; // cells in a level up
+            if (next & up - 1 || next + up > key)
+                break;
+            level++;
+        }
+        emit(background, level);
+    }
+}
+
+
+void
+GridBuilder::add(SBox s, Tile t)
+{
+    int level = 0;
+    while (1 << level < s.size())
+        level++;
+    assert(s.size() == 1 << level && level <= levels);
+    assert(glm::all(glm::equal(s.p0() & (s.size() - 1), ivec3(0))));
+
+    uint64_t key = Morton(s.p0()).key();
+    assert(key >= next && key < uint64_t(1) << 3 * levels);
+    skip_to(key);
+    emit(t, level);
+}
+
+Node
+GridBuilder::finish()
+{
+    skip_to(uint64_t(1) << 3 * levels);
+    return std::move(root);
+}
+
+
+
+//
+// View
+//
+
+bool
+View::build(const function<BuildBlock(Box)>& f) const
+{
+    if (world || !grid->ctop().is_tile())
+        return false;
+    GridBuilder builder(grid->size(), grid->ctop().tile());
+    Box g = grid_box();
+    iloc r = ~l;
+    builder.add_blocks(SBox{grid->size()}, [&] (SBox s) {
+        if ((g & s).empty())
+            return BuildBlock{ BuildBlock::background };
+        if (!g.contains(s))
+            return BuildBlock{ BuildBlock::mixed };
+        return f(r * Box{s});
+    });
+    grid->top().replace(builder.finish());
+    return true;
+}
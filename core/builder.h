@@ -0,0 +1,77 @@
+#ifndef CORE_BUILDER_H
+#define CORE_BUILDER_H
+
+#include "grid.h"
+#include "morton.h"
+
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+using boost::noncopyable;
+
+
+// Builds a grid bottom-up from tiles given in coord_less order, in one pass.
+// Each tile covers an aligned power-of-two box, as tiles in a grid do, and
+// whatever lies between tiles is background. Each level of the tree keeps the
+// octet it is filling; a complete octet of equal tiles becomes one tile of its
+// parent, and others become a branch, so no branch is allocated that would
+// later be merged away.
+
+// A tile range, such as that of a PackedGrid or a snapshot, can be fed in as
+// it is. Painters that can tell what a whole block becomes use add_blocks().
+
+// What a block becomes: left as background, filled with one tile, or mixed
+// and to be asked about in smaller blocks. Unit blocks aren't mixed.
+struct BuildBlock {
+    enum Kind { background, fill, mixed } kind;
+    Tile tile;
+};
+
+class GridBuilder : noncopyable {
+    int levels; // root is at this level, unit tiles at 0
+    uint64_t next; // Morton key of the first cell not yet added
+    Tile background;
+    Node pending[Morton::bits + 1][8]; // octet being filled at each level
+    Node root;
+
+    void emit(Node, int level);
+    void skip_to(uint64_t key); // background up to key
+
+public:
+    // size is a power of two
+    explicit GridBuilder(int size, Tile background = Tile::empty());
+
+    int size() const { return 1 << levels; }
+
+    // after all tiles added so far, not overlapping them
+    void add(SBox, Tile);
+    void add(pair<SBox, Tile> st) { add(st.first, st.second); }
+
+    // Add tiles in s from f(SBox) -> BuildBlock, asked top-down and
+    // depth-first.
+    template<typename F>
+    void add_blocks(SBox s, F&& f);
+
+    // The root, with background filling the rest of the grid. The builder
+    // can't be used after this.
+    Node finish();
+    Grid grid() { int s = size(); return Grid(s, finish()); }
+};
+
+
+template<typename F>
+void
+GridBuilder::add_blocks(SBox s, F&& f)
+{
+    BuildBlock b = f(s);
+    if (b.kind == BuildBlock::mixed) {
+        assert(s.size() > 1);
+        for (auto i: ioct::all())
+            add_blocks(s.leaf(i), f);
+    } else if (b.kind == BuildBlock::fill)
+        add(s, b.tile);
+}
+
+
+#endif
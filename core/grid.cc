@@ -4,10 +4,27 @@
 #include "debug.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
+using std::atomic;
 using std::cout;
+using std::lock_guard;
 using std::max;
+using std::mutex;
+using std::thread;
+using std::unordered_set;
+using std::vector;
 
 
 //
@@ -31,6 +48,264 @@ operator<<(ostream& s, const Node& n) {
 
 
 
+//
+// BranchPool
+//
+
+namespace {
+
+const size_t cache_line = BranchPool::cache_line;
+
+union FreeBranch {
+    FreeBranch* next;
+    alignas(cache_line) char storage[sizeof(Branch)];
+};
+
+static_assert(sizeof(FreeBranch) == cache_line, "branch not one cache line");
+
+const size_t slab_branches = BranchPool::slab_branches;
+
+struct Slab {
+    BranchPool::Header header[BranchPool::header_lines * cache_line /
+                              sizeof(BranchPool::Header)];
+    FreeBranch branch[slab_branches];
+};
+
+static_assert(sizeof(Slab) == BranchPool::slab_bytes, "slab size");
+
+// Take up to n branches from the front of a list, return the rest.
+FreeBranch*
+split_list(FreeBranch*& list, size_t n, size_t& taken)
+{
+    FreeBranch* head = list;
+    FreeBranch** tail = &head;
+    for (taken = 0; taken < n && *tail; taken++)
+        tail = &(*tail)->next;
+    list = *tail;
+    *tail = nullptr;
+    return head;
+}
+
+struct SharedPool {
+    mutex lock;
+    vector<Slab*> slabs; // never freed
+    FreeBranch* free = nullptr;
+    atomic<size_t> live{0};
+
+    // Slabs are linked in address order, so consecutive allocations are
+    // adjacent.
+    void grow() {
+        // new can't allocate with alignment
+        void* p;
+        if (posix_memalign(&p, sizeof(Slab), sizeof(Slab)))
+            throw std::bad_alloc();
+        Slab* slab = new (p) Slab;
+        slabs.push_back(slab);
+        for (size_t i = slab_branches; i-- > 0;) {
+            slab->branch[i].next = free;
+            free = &slab->branch[i];
+        }
+    }
+
+    FreeBranch* take(size_t n, size_t& taken) {
+        lock_guard<mutex> guard(lock);
+        if (!free)
+            grow();
+        return split_list(free, n, taken);
+    }
+
+    void give(FreeBranch* head, FreeBranch* tail) {
+        lock_guard<mutex> guard(lock);
+        tail->next = free;
+        free = head;
+    }
+};
+
+// Leaked deliberately: branches in static grids may be released after all
+// other static objects are destroyed.
+SharedPool& shared_pool = *new SharedPool;
+
+const size_t cache_batch = 64;
+
+struct ThreadCache {
+    FreeBranch* free = nullptr;
+    size_t count = 0;
+
+    ~ThreadCache();
+
+    void* allocate() {
+        if (!free)
+            free = shared_pool.take(cache_batch, count);
+        count--;
+        return exchange(free, free->next);
+    }
+
+    void release(FreeBranch* b) {
+        b->next = exchange(free, b);
+        if (++count > 2 * cache_batch) {
+            size_t n;
+            FreeBranch* batch = split_list(free, cache_batch, n);
+            count -= n;
+            FreeBranch* tail = batch;
+            while (tail->next)
+                tail = tail->next;
+            shared_pool.give(batch, tail);
+        }
+    }
+};
+
+thread_local ThreadCache thread_cache;
+thread_local bool thread_cache_done; // trivial, so valid after ~ThreadCache
+
+ThreadCache::~ThreadCache()
+{
+    if (free) {
+        FreeBranch* tail = free;
+        while (tail->next)
+            tail = tail->next;
+        shared_pool.give(free, tail);
+    }
+    thread_cache_done = true;
+}
+
+}
+
+void*
+BranchPool::allocate()
+{
+    shared_pool.live.fetch_add(1, std::memory_order_relaxed);
+    void* p;
+    if (thread_cache_done) { // only during thread exit
+        size_t n;
+        p = shared_pool.take(1, n);
+    } else
+        p = thread_cache.allocate();
+    refs(p).store(1, std::memory_order_relaxed);
+    return p;
+}
+
+void
+BranchPool::release(void* p)
+{
+    shared_pool.live.fetch_sub(1, std::memory_order_relaxed);
+    auto b = static_cast<FreeBranch*>(p);
+    if (thread_cache_done)
+        shared_pool.give(b, b);
+    else
+        thread_cache.release(b);
+}
+
+BranchPool::Stats
+BranchPool::stats()
+{
+    lock_guard<mutex> guard(shared_pool.lock);
+    size_t slabs = shared_pool.slabs.size();
+    return { slabs, shared_pool.live.load(std::memory_order_relaxed),
+             slabs * sizeof(Slab) };
+}
+
+void*
+Branch::operator new(size_t size)
+{
+    assert(size == sizeof(Branch));
+    return BranchPool::allocate();
+}
+
+void
+Branch::operator delete(void* p)
+{
+    BranchPool::release(p);
+}
+
+
+void
+Branch::summarize()
+{
+    BranchSummary r{0, 0, 0, 7, 0, 1};
+    for (int i = 0; i < 8; i++) {
+        const Node& c = child[i];
+        if (c.is_tile()) {
+            Tile t = c.tile();
+            if (!t)
+                continue;
+            r.occupied |= 1 << i;
+            if (t.shape())
+                r.shaped = 1;
+            else
+                r.solid |= 1 << i;
+            if (t.hp() < r.min_hp)
+                r.min_hp = t.hp();
+            if (t.hp() > r.max_hp)
+                r.max_hp = t.hp();
+        } else if (c.is_null()) {
+            r.occupied |= 1 << i;
+            r.shaped = 1;
+            r.min_hp = 0;
+            r.max_hp = 7;
+        } else {
+            Branch& b = c.branch();
+            // a shared branch may be read by other threads, so leave it
+            if (!b.summary().valid && !b.shared())
+                b.summarize();
+            const BranchSummary& s = b.summary();
+            if (!s.valid) {
+                r.valid = 0;
+                break;
+            }
+            if (s.occupied)
+                r.occupied |= 1 << i;
+            if (s.solid == 0xff)
+                r.solid |= 1 << i;
+            r.shaped |= s.shaped;
+            if (s.min_hp < r.min_hp)
+                r.min_hp = s.min_hp;
+            if (s.max_hp > r.max_hp)
+                r.max_hp = s.max_hp;
+        }
+    }
+    BranchPool::header(this).summary = r;
+}
+
+
+
+//
+// GridJournal
+//
+
+atomic<uint64_t> GridJournal::counter{0};
+
+void
+GridJournal::each_change(uint64_t since, Box bound,
+                         function<void(Box)> callback) const
+{
+    if (since < forgotten || since > _generation) {
+        callback(bound);
+        return;
+    }
+    for (auto e = entries.rbegin(); e != entries.rend(); ++e) {
+        if (e->generation <= since)
+            break;
+        if (e->b.intersects(bound))
+            callback(e->b & bound);
+    }
+}
+
+bool
+GridJournal::changed(uint64_t since, Box bound) const
+{
+    if (since < forgotten || since > _generation)
+        return true;
+    for (auto e = entries.rbegin(); e != entries.rend(); ++e) {
+        if (e->generation <= since)
+            break;
+        if (e->b.intersects(bound))
+            return true;
+    }
+    return false;
+}
+
+
+
 //
 // Grid and cursor
 //
@@ -43,36 +318,288 @@ detail::CursorCommon::containing_sbox(SBox b)
     return ivec3(b.x0() & mask, b.y0() & mask, b.z0() & mask) + SBox(d);
 }
 
+
+// The ray is followed through the octree front to back. Within a branch, the
+// times at which it crosses the three center planes give the sequence of
+// children it passes through, so each child is visited with the interval it
+// covers and nodes that are empty as a whole are skipped at once.
+
+namespace {
+
+// Hit on a non-empty tile that the ray is inside of for t0 <= t <= t1, with
+// normal being that of the face it entered through.
+optional<RayHit>
+tile_hit(SBox s, Tile t, dvec3 o, dvec3 d, double t0, double t1, dvec3 normal)
+{
+    double th = t0;
+    if (t.shape()) {
+        // plane is in tile coordinates, (p - p0) / size
+        dvec4 plane = t.shape_plane();
+        dvec3 n(plane);
+        double f0 = glm::dot(n, (o - dvec3(s.p0())) / double(s.size())) +
+                    plane.w;
+        double f1 = glm::dot(n, d) / s.size();
+        if (f0 + f1 * t0 < 0) {
+            if (f1 <= 0)
+                return {};
+            th = -f0 / f1;
+            if (th > t1)
+                return {};
+            normal = -glm::normalize(n);
+        }
+    }
+    return RayHit{ o + d * th, normal, th, s, t };
+}
+
+struct RayCast {
+    dvec3 o, d, inv;
+    const detail::ConstCursor* base; // below an overlay, if any
+    optional<RayHit> hit;
+
+    // ray is inside the node for t0 <= t <= t1, having entered through a face
+    // perpendicular to axis, or -1 if it started there
+    bool visit(detail::ConstCursor c, double t0, double t1, int axis);
+
+    dvec3 face_normal(int axis) const {
+        dvec3 n(0);
+        if (axis >= 0)
+            n[axis] = d[axis] > 0 ? -1 : 1;
+        return n;
+    }
+};
+
 bool
-detail::CursorCommon::coord_less(ivec3 a, ivec3 b)
+RayCast::visit(detail::ConstCursor c, double t0, double t1, int axis)
 {
-    assert(glm::compMin(a) >= 0 && glm::compMin(b) >= 0);
-    int i = 0, j = 0;
-    for (int d = 1;; d <<= 1) {
-        if (a == b)
-            return i < j;
-        i = ioct(a.x & d, a.y & d, a.z & d).i();
-        j = ioct(b.x & d, b.y & d, b.z & d).i();
-        a = ivec3(a.x & ~d, a.y & ~d, a.z & ~d),
-        b = ivec3(b.x & ~d, b.y & ~d, b.z & ~d);
+    SBox s = c.box();
+    if (c.is_null()) {
+        // what is below is a tile at least as large, or a node the same size
+        if (!base)
+            return false;
+        auto b = base->find_smallest(s);
+        return !b.is_null() && visit(b, t0, t1, axis);
+    }
+    if (c.is_tile()) {
+        Tile t = c.tile();
+        if (t)
+            hit = tile_hit(s, t, o, d, t0, t1, face_normal(axis));
+        return bool(hit);
+    }
+
+    int occupied = c.occupied();
+    if (!occupied)
+        return false;
+
+    dvec3 center(s.center());
+    double tm[3];
+    int side = 0;
+    for (int a = 0; a < 3; a++)
+        if (d[a] == 0) {
+            tm[a] = std::numeric_limits<double>::infinity();
+            side |= (o[a] >= center[a]) << a;
+        } else {
+            tm[a] = (center[a] - o[a]) * inv[a];
+            side |= ((d[a] > 0) == (t0 >= tm[a])) << a;
+        }
+
+    for (double t = t0;;) {
+        double tn = t1;
+        for (int a = 0; a < 3; a++)
+            if (tm[a] > t && tm[a] < tn)
+                tn = tm[a];
+        if (occupied >> side & 1 && visit(c[ioct{side}], t, tn, axis))
+            return true;
+        if (tn >= t1)
+            return false;
+        for (int a = 0; a < 3; a++)
+            if (tm[a] == tn) {
+                side ^= 1 << a;
+                axis = a;
+            }
+        t = tn;
     }
 }
 
+}
+
+optional<RayHit>
+detail::ConstCursor::raycast(dvec3 origin, dvec3 direction,
+                             double length) const
+{
+    return raycast(origin, direction, length, nullptr);
+}
+
+optional<RayHit>
+detail::ConstCursor::raycast(dvec3 origin, dvec3 direction, double length,
+                             const ConstCursor& base) const
+{
+    assert(base.box() == s);
+    return raycast(origin, direction, length, &base);
+}
+
+optional<RayHit>
+detail::ConstCursor::raycast(dvec3 origin, dvec3 direction, double length,
+                             const ConstCursor* base) const
+{
+    RayCast r{origin, direction, 1. / direction, base};
+    double t0 = 0, t1 = length;
+    int axis = -1;
+    for (int a = 0; a < 3; a++)
+        if (direction[a] == 0) {
+            if (origin[a] < s.p0()[a] || origin[a] > s.p1()[a])
+                return {};
+        } else {
+            double ta = (s.p0()[a] - origin[a]) * r.inv[a],
+                   tb = (s.p1()[a] - origin[a]) * r.inv[a];
+            if (ta > tb)
+                std::swap(ta, tb);
+            if (ta > t0) {
+                t0 = ta;
+                axis = a;
+            }
+            t1 = std::min(t1, tb);
+        }
+    if (t0 > t1)
+        return {};
+    r.visit(*this, t0, t1, axis);
+    return r.hit;
+}
+
+
+// All rays go the same way, so the same order of children is front to back for
+// each of them: counting up with the bits flipped for axes along which the
+// direction is negative, any child a ray passes through after another has a
+// superset of its (flipped) bits. A ray drops out of the packet as soon as a
+// node starts further away than its nearest hit so far.
+
+RayPacket::RayPacket(dvec3 direction, double length) :
+    d(direction), length(length)
+{
+    // avoid 0 * infinity in the slab tests; a ray parallel to a slab is
+    // either inside it or far outside it
+    for (int a = 0; a < 3; a++)
+        inv[a] = 1. / (d[a] ? d[a] : 1e-300);
+}
+
+Box
+RayPacket::bound() const
+{
+    dvec3 lo(std::numeric_limits<double>::infinity()), hi(-lo);
+    for (int i = 0; i < n; i++) {
+        dvec3 p(o[0][i], o[1][i], o[2][i]);
+        lo = glm::min(lo, glm::min(p, p + d * length));
+        hi = glm::max(hi, glm::max(p, p + d * length));
+    }
+    if (!n)
+        return Box{ivec3(0)};
+    return Box::ranged(ivec3(glm::floor(lo)), ivec3(glm::floor(hi)) + 1);
+}
+
+namespace {
+
+struct PacketCast {
+    const double (&o)[3][RayPacket::max_rays];
+    optional<RayHit>* hits;
+    int n;
+    dvec3 d, inv;
+    double length;
+    int flip;
+    const detail::ConstCursor* base; // below an overlay, if any
+
+    // s is the box of c, or part of it where c is a tile below an overlay
+    void visit(detail::ConstCursor c, SBox s);
+    void visit(detail::ConstCursor c) { visit(c, c.box()); }
+};
 
 void
-detail::ConstCursor::each_tile(Box bound,
-                               function<void(SBox, Tile)> callback) const
+PacketCast::visit(detail::ConstCursor c, SBox s)
 {
-    // NOTE: client code may expect this to iterate over complete tiles;
-    // investigate before changing this to subdivide by bound
-    if (bound.intersects(s))
-        if (!is_tile())
-            for (auto i: ioct::all())
-                (*this)[i].each_tile(bound, callback);
-        else if (Tile t = tile())
-            callback(s, t);
+    if (c.is_null()) {
+        // what is below is a tile at least as large, or a node the same size
+        if (base) {
+            auto b = base->find_smallest(s);
+            if (!b.is_null())
+                visit(b, s);
+        }
+        return;
+    }
+    if (c.is_vacant())
+        return;
+
+    double t0[RayPacket::max_rays], t1[RayPacket::max_rays];
+    int axis[RayPacket::max_rays];
+    for (int i = 0; i < n; i++) {
+        t0[i] = 0;
+        t1[i] = hits[i] ? hits[i]->distance : length;
+        axis[i] = -1;
+    }
+    for (int a = 0; a < 3; a++) {
+        double p0 = s.p0()[a], p1 = s.p1()[a];
+        for (int i = 0; i < n; i++) {
+            double ta = (p0 - o[a][i]) * inv[a],
+                   tb = (p1 - o[a][i]) * inv[a];
+            double near = ta < tb ? ta : tb, far = ta < tb ? tb : ta;
+            if (near > t0[i]) {
+                t0[i] = near;
+                axis[i] = a;
+            }
+            t1[i] = far < t1[i] ? far : t1[i];
+        }
+    }
+    bool any = false;
+    for (int i = 0; i < n; i++)
+        any |= t0[i] <= t1[i];
+    if (!any)
+        return;
+
+    if (c.is_tile()) {
+        Tile t = c.tile();
+        for (int i = 0; i < n; i++)
+            if (t0[i] <= t1[i]) {
+                dvec3 origin(o[0][i], o[1][i], o[2][i]), normal(0);
+                if (axis[i] >= 0)
+                    normal[axis[i]] = d[axis[i]] > 0 ? -1 : 1;
+                if (auto h = tile_hit(c.box(), t, origin, d, t0[i], t1[i],
+                                      normal))
+                    hits[i] = h;
+            }
+        return;
+    }
+
+    int occupied = c.occupied();
+    for (int k = 0; k < 8; k++)
+        if (occupied >> (k ^ flip) & 1)
+            visit(c[ioct{k ^ flip}]);
+}
+
+}
+
+void
+detail::ConstCursor::raycast(RayPacket& p) const
+{
+    raycast(p, nullptr);
+}
+
+void
+detail::ConstCursor::raycast(RayPacket& p, const ConstCursor& base) const
+{
+    assert(base.box() == s);
+    raycast(p, &base);
+}
+
+void
+detail::ConstCursor::raycast(RayPacket& p, const ConstCursor* base) const
+{
+    int flip = 0;
+    for (int a = 0; a < 3; a++)
+        flip |= (p.d[a] < 0) << a;
+    for (int i = 0; i < p.n; i++)
+        p.hits[i] = {};
+    PacketCast{p.o, p.hits, p.n, p.d, p.inv, p.length, flip, base}
+        .visit(*this);
 }
 
+
 #ifndef NDEBUG
 void
 detail::ConstCursor::show_text(int indent) const
@@ -87,7 +614,509 @@ detail::ConstCursor::show_text(int indent) const
 #endif
 
 
-// TODO: this should be made faster
+// Fill visits only the nodes that partially intersect the box, which are the
+// boundary of its minimal octree cover. Children are classified per axis
+// against the parent's center, so each level costs a few comparisons rather
+// than full Box tests on all eight children. Children that become uniform are
+// merged on the way back up.
+
+namespace {
+
+// octants in the low and high half along each axis
+const int octant_half[3][2] = { { 0x55, 0xaa }, { 0x33, 0xcc }, { 0x0f, 0xf0 } };
+
+}
+
+void
+detail::Cursor::fill(Box b, Tile t) const
+{
+    if (b.contains(s)) {
+        record(s);
+        node = t;
+        return;
+    }
+    // zero-width boxes do intersect by Box::intersects()
+    if (b.empty() || !b.intersects(s))
+        return;
+    record(b & s);
+
+    struct Frame {
+        Node* node;
+        ivec3 p;
+        int size;
+        int partial; // children still to be visited
+    };
+    Frame stack[sizeof(int) * 8];
+    int depth = 0;
+
+    bool mergeable = !t || !t.shape();
+    ivec3 b0 = b.p0(), b1 = b.p1();
+
+    auto enter = [&] (Node& n, ivec3 p, int size) {
+        // NOTE: it's assumed that complex tiles are only created with size 1,
+        // so we don't check to prevent subdividing complex tiles
+        subdivide(n);
+        int h = size / 2;
+        ivec3 c = p + h;
+        int intersects = 0xff, contains = 0xff;
+        for (int a = 0; a < 3; a++) {
+            const int* half = octant_half[a];
+            intersects &= (b0[a] < c[a] ? half[0] : 0) |
+                          (b1[a] > c[a] ? half[1] : 0);
+            contains &= (b0[a] <= p[a] && b1[a] >= c[a] ? half[0] : 0) |
+                        (b0[a] <= c[a] && b1[a] >= p[a] + size ? half[1] : 0);
+        }
+        Branch& branch = n.branch();
+        for (int m = contains; m; m &= m-1)
+            branch[ioct{__builtin_ctz(m)}] = t;
+        stack[depth++] = { &n, p, size, intersects & ~contains };
+    };
+
+    enter(node, s.p0(), s.size());
+    while (depth) {
+        Frame& f = stack[depth-1];
+        if (f.partial) {
+            // integer boxes never partially intersect unit nodes
+            assert(f.size > 2);
+            ioct i{__builtin_ctz(f.partial)};
+            f.partial &= f.partial-1;
+            int h = f.size / 2;
+            enter(f.node->branch()[i], f.p + i * h, h);
+        } else {
+            depth--;
+            Branch& branch = f.node->branch();
+            if (mergeable) {
+                bool all_same = true;
+                for (auto i: ioct::all()) {
+                    Node& c = branch[i];
+                    all_same &= c.is_tile() && c.tile() == t;
+                }
+                if (all_same) {
+                    *f.node = t;
+                    continue;
+                }
+            }
+            branch.summarize();
+        }
+    }
+}
+
+
+namespace {
+
+// A branch whose children were edited: summarized, and replaced by their tile
+// if they all became the same one.
+void
+merge_uniform(Node& node)
+{
+    Branch& branch = node.branch();
+    branch.summarize();
+
+    Node& first = branch[ioct{0}];
+    if (!first.is_tile())
+        return;
+    Tile t = first.tile();
+    if (t && t.shape())
+        return;
+    for (auto i: ioct::all())
+        if (!branch[i].is_tile() || branch[i].tile() != t)
+            return;
+    node = t;
+}
+
+}
+
+// Edits for this node are list[begin:]. Children append their own lists after
+// that and truncate them when done.
+void
+detail::Cursor::apply_recurse(Node& node, SBox s,
+                              const vector<EditBatch::Edit>& edits,
+                              vector<unsigned>& list, size_t begin)
+{
+    // the last edit covering the whole node overrides everything before it
+    const EditBatch::Edit* cover = nullptr;
+    for (size_t i = begin; i < list.size(); i++) {
+        auto& e = edits[list[i]];
+        if (e.b.contains(s) && (!cover || e.seq > cover->seq))
+            cover = &e;
+    }
+    if (cover) {
+        node = cover->t;
+        size_t j = begin;
+        for (size_t i = begin; i < list.size(); i++)
+            if (edits[list[i]].seq > cover->seq)
+                list[j++] = list[i];
+        list.resize(j);
+        if (j == begin)
+            return;
+    }
+
+    size_t end = list.size();
+    subdivide(node);
+    Branch& branch = node.branch();
+    for (auto i: ioct::all()) {
+        SBox c = s.leaf(i);
+        for (size_t k = begin; k < end; k++)
+            if (edits[list[k]].b.intersects(c))
+                list.push_back(list[k]);
+        if (list.size() > end) {
+            apply_recurse(branch[i], c, edits, list, end);
+            list.resize(end);
+        }
+    }
+    merge_uniform(node);
+}
+
+void
+detail::Cursor::apply(const EditBatch& batch) const
+{
+    // clipped to this node; each node below only looks at those that reach
+    // it, so their order doesn't matter beyond seq
+    vector<EditBatch::Edit> edits;
+    edits.reserve(batch.edits.size());
+    for (auto e: batch.edits) {
+        e.b &= s;
+        if (!e.b.empty()) {
+            record(e.b);
+            edits.push_back(e);
+        }
+    }
+
+    if (edits.empty())
+        return;
+    vector<unsigned> list;
+    list.reserve(edits.size() * 2);
+    for (unsigned i = 0; i < edits.size(); i++)
+        list.push_back(i);
+    apply_recurse(node, s, edits, list, 0);
+}
+
+
+// Branches by content. Children are deduplicated first, so equal content means
+// equal subtrees.
+struct detail::Cursor::BranchTable {
+    struct Hash {
+        size_t operator()(Branch* b) const {
+            size_t h = 0;
+            for (auto i: ioct::all())
+                h = h * 31 + (*b)[i].hash();
+            return h;
+        }
+    };
+    struct Equal {
+        bool operator()(Branch* a, Branch* b) const {
+            for (auto i: ioct::all())
+                if ((*a)[i] != (*b)[i])
+                    return false;
+            return true;
+        }
+    };
+    unordered_set<Branch*, Hash, Equal> branches;
+};
+
+void
+detail::Cursor::deduplicate_recurse(Node& node, BranchTable& table)
+{
+    if (!node.is_branch())
+        return;
+    // a shared branch may be seen by other grids, so leave its children alone
+    if (!node.branch().shared())
+        for (auto i: ioct::all())
+            deduplicate_recurse(node.branch()[i], table);
+    // the branch found in the table is still referenced from wherever it was
+    // first seen, so it stays valid even when this one is released
+    auto r = table.branches.insert(&node.branch());
+    if (!r.second) {
+        (*r.first)->ref();
+        node = unique_ptr<Branch>(*r.first); // carries the new reference
+    }
+}
+
+void
+detail::Cursor::deduplicate() const
+{
+    BranchTable table;
+    deduplicate_recurse(node, table);
+}
+
+
+// Split: the parts are detached as they are, so a worker's grid starts with
+// the same branches (shared ones still shared) and its edits are recorded in
+// its own journal. The whole node is recorded as changed in ours.
+
+unsigned split_threads = 0;
+
+namespace {
+
+// levels above the parts, bottom up
+void
+merge_split(Node& node, int depth)
+{
+    if (!depth || !node.is_branch())
+        return;
+    for (auto i: ioct::all())
+        merge_split(node.branch()[i], depth - 1);
+    merge_uniform(node);
+}
+
+}
+
+void
+detail::Cursor::split(int depth,
+                      const function<void(ivec3, Grid&)>& f) const
+{
+    while (depth > 0 && s.size() >> depth == 0)
+        depth--;
+    record(s);
+
+    struct Part {
+        Node* node;
+        ivec3 origin;
+        Grid grid;
+    };
+    vector<Part> parts;
+    int size = s.size() >> depth;
+    for (auto p: Box{ivec3(1 << depth)}.coords()) {
+        ivec3 origin = s.p0() + p * size;
+        Node* n = &node;
+        SBox b = s;
+        while (b.size() > size) {
+            subdivide(*n);
+            ioct i{glm::greaterThanEqual(origin, b.center())};
+            n = &n->branch()[i];
+            b = b.leaf(i);
+        }
+        parts.push_back({ n, origin, Grid(size, std::move(*n)) });
+    }
+
+    atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next++) < parts.size();)
+            f(parts[i].origin, parts[i].grid);
+    };
+    size_t n = split_threads ? split_threads : thread::hardware_concurrency();
+    n = std::min(std::max(n, size_t(1)), parts.size());
+    vector<thread> workers;
+    for (size_t i = 1; i < n; i++)
+        workers.emplace_back(work);
+    work();
+    for (auto& w: workers)
+        w.join();
+
+    for (auto& part: parts)
+        *part.node = std::move(part.grid.root);
+    merge_split(node, depth);
+}
+
+
+// Merge: tiles of the overlay are copied, and its branches descended into,
+// since they may have null nodes below. The overlay isn't changed.
+
+void
+detail::Cursor::merge_recurse(Node& node, const ConstCursor& overlay) const
+{
+    if (overlay.is_null())
+        return;
+    if (overlay.is_tile()) {
+        record(overlay.box());
+        node = overlay.tile();
+        return;
+    }
+    subdivide(node);
+    for (auto i: ioct::all())
+        merge_recurse(node.branch()[i], overlay[i]);
+    merge_uniform(node);
+}
+
+void
+detail::Cursor::merge(const ConstCursor& overlay) const
+{
+    assert(overlay.box() == s);
+    merge_recurse(node, overlay);
+}
+
+
+void
+detail::Cursor::graft_recurse(Node& node, SBox s, SBox b, Node n)
+{
+    if (s.size() == b.size()) {
+        assert(s == b);
+        node = std::move(n);
+        return;
+    }
+    subdivide(node);
+    ioct i{glm::greaterThanEqual(b.p0(), s.center())};
+    graft_recurse(node.branch()[i], s.leaf(i), b, std::move(n));
+    merge_uniform(node);
+}
+
+void
+detail::Cursor::graft(SBox b, Node n) const
+{
+    assert(s.contains(b));
+    record(b);
+    graft_recurse(node, s, b, std::move(n));
+}
+
+
+// Stats: only shared branches can be reached more than once, so only those
+// are remembered.
+
+namespace {
+
+void
+add_stats(GridStats& r, unordered_set<const Branch*>& seen, const Node& n,
+          int level, int depth)
+{
+    if (n.is_branch()) {
+        Branch& b = n.branch();
+        if (b.shared()) {
+            if (!seen.insert(&b).second)
+                return;
+            r.shared++;
+        }
+        r.branches++;
+        r.branches_at[depth]++;
+        for (auto i: ioct::all())
+            add_stats(r, seen, b[i], level - 1, depth + 1);
+        return;
+    }
+    r.depth = max(r.depth, depth);
+    r.leaves_at[level]++;
+    if (n.is_null())
+        r.null++;
+    else if (!n.tile())
+        r.empty++;
+    else if (n.tile().shape())
+        r.shaped++;
+    else
+        r.cubes++;
+}
+
+}
+
+GridStats
+Grid::stats() const
+{
+    GridStats r;
+    unordered_set<const Branch*> seen;
+    add_stats(r, seen, root, __builtin_ctz(_size), 0);
+    return r;
+}
+
+double
+GridStats::merge_ratio() const
+{
+    double cells = 0;
+    for (int l = 0; l < max_levels; l++)
+        cells += std::ldexp(double(leaves_at[l]), 3 * l);
+    return leaves() ? cells / leaves() : 0;
+}
+
+#ifndef NDEBUG
+void
+GridStats::show() const
+{
+    cout << branches << " branches (" << shared << " shared), "
+         << bytes() / 1024 << " KiB\n";
+    cout << leaves() << " leaves: " << cubes << " cubes, " << shaped
+         << " shaped, " << empty << " empty, " << null << " null\n";
+    cout << "merge ratio " << merge_ratio() << ", depth " << depth << '\n';
+    cout << "branches by depth:";
+    for (int d = 0; d < depth; d++)
+        cout << ' ' << branches_at[d];
+    cout << "\nleaves by level:";
+    int top = max_levels;
+    while (top > 0 && !leaves_at[top - 1])
+        top--;
+    for (int l = 0; l < top; l++)
+        cout << ' ' << leaves_at[l];
+    cout << '\n';
+}
+#endif
+
+
+// Lazy generation: branches are only created, or copied if shared, on paths
+// to chunks that are still null, so asking for what is already there edits
+// nothing.
+
+namespace {
+
+bool
+pending(const Node& node, SBox s, Box b, int chunk)
+{
+    if (node.is_null())
+        return true;
+    if (!node.is_branch() || s.size() == chunk)
+        return false;
+    for (auto i: ioct::all())
+        if (b.intersects(s.leaf(i)) &&
+                pending(node.branch()[i], s.leaf(i), b, chunk))
+            return true;
+    return false;
+}
+
+}
+
+void
+Grid::generate_lazily(int chunk, function<void(View)> generator)
+{
+    assert(chunk > 0 && !(chunk & (chunk - 1)) && chunk <= _size);
+    lazy = std::make_shared<const Lazy>(Lazy{ chunk, std::move(generator) });
+    top().replace(Node());
+}
+
+size_t
+Grid::generate(Box b)
+{
+    if (!lazy || !pending(root, SBox{_size}, b, lazy->chunk))
+        return 0;
+    return generate_recurse(root, SBox{_size}, b);
+}
+
+size_t
+Grid::generate_recurse(Node& node, SBox s, Box b)
+{
+    if (s.size() == lazy->chunk) {
+        Grid chunk(s.size(), Tile::empty());
+        lazy->generator(View(chunk).translate(-s.p0()));
+        node = std::move(chunk.root);
+        journal.record(s);
+        return 1;
+    }
+
+    if (node.is_null())
+        node = unique_ptr<Branch>(new Branch());
+    else if (node.branch().shared())
+        node = node.branch().copy();
+    size_t n = 0;
+    for (auto i: ioct::all()) {
+        Node& child = node.branch()[i];
+        if (b.intersects(s.leaf(i)) &&
+                pending(child, s.leaf(i), b, lazy->chunk))
+            n += generate_recurse(child, s.leaf(i), b);
+    }
+    merge_uniform(node);
+    return n;
+}
+
+
+Grid
+Grid::part(SBox b) const
+{
+    assert(SBox{_size}.contains(b));
+    const Node* node = &root;
+    SBox s{_size};
+    while (s.size() > b.size() && node->is_branch()) {
+        ioct i{glm::greaterThanEqual(b.p0(), s.center())};
+        node = &node->branch()[i];
+        s = s.leaf(i);
+    }
+    assert(s.contains(b) && (s == b || !node->is_branch()));
+    return Grid(b.size(), node->share());
+}
+
+
 bool
 detail::Cursor::fill_recurse(Box b, Tile t) const
 {
@@ -102,6 +1131,8 @@ detail::Cursor::fill_recurse(Box b, Tile t) const
             all_same &= (*this)[i].fill_recurse(b, t);
         if (all_same && (!t || !t.shape()))
             node = t;
+        else
+            node.branch().summarize();
     }
     return node.is_tile() && node.tile() == t;
 }
@@ -113,13 +1144,119 @@ detail::Cursor::fill_recurse(Box b, Tile t) const
 //
 
 void
-View::each_tile(function<void(SBox, Tile)> callback) const
+View::parallel(int depth, const function<void(View, Box)>& f) const
 {
-    grid->ctop().each_tile(
-        grid_box(),
-        [&] (SBox s, Tile t) { callback((~l * Box{s}).sbox(), t); });
+    if (world) {
+        f(*this, b);
+        return;
+    }
+    Box g = grid_box();
+    grid->split(depth, [&] (ivec3 origin, Grid& part) {
+        Box p = g & (origin + SBox{part.size()});
+        if (!p.empty())
+            f(View(&part, nullptr, b, iloc{-origin, {}} * l), ~l * p);
+    });
 }
 
+// Copy: the source is walked within the region, and each node is mapped to
+// the target by the transform between the grids. Tiles go into one batch;
+// whole subtrees that land on aligned nodes are grafted, if they have no null
+// nodes that would have to be left out.
+
+namespace {
+
+struct RegionCopy {
+    Box region; // in source grid coordinates
+    iloc t, r; // source to target grid coordinates, and only its rotation
+    bool turned; // r isn't identity
+    int target_size; // 0 for no grafts
+    EditBatch batch;
+    vector<pair<SBox, Node>> grafts;
+
+    // octant that octant i of a node ends up in
+    ioct turn(ioct i) const {
+        ivec3 v = r * (ivec3(i.bvec3_cast()) * 2 - 1);
+        return ioct{glm::greaterThan(v, ivec3(0))};
+    }
+
+    Tile turn(Tile tile) const {
+        if (!turned || !tile || !tile.shape())
+            return tile;
+        boct from = tile.shape_corners(), to{0};
+        for (auto i: ioct::all())
+            if (from[i])
+                to[turn(i)] = true;
+        return tile.shape(to);
+    }
+
+    Node turn(const Node& n) const {
+        if (n.is_tile())
+            return turn(n.tile());
+        if (!turned)
+            return n.share();
+        unique_ptr<Branch> b(new Branch());
+        for (auto i: ioct::all())
+            (*b)[turn(i)] = turn(n.branch()[i]);
+        b->summarize();
+        return b;
+    }
+
+    static bool complete(const Node& n) { // no null below
+        if (!n.is_branch())
+            return n.is_tile();
+        for (auto i: ioct::all())
+            if (!complete(n.branch()[i]))
+                return false;
+        return true;
+    }
+
+    bool graftable(Box d) const {
+        if (!target_size || !Box{SBox{target_size}}.contains(d))
+            return false;
+        int m = d.size().x - 1;
+        return !(d.x0() & m) && !(d.y0() & m) && !(d.z0() & m);
+    }
+
+    void visit(const Node& n, SBox s) {
+        if (n.is_null() || !region.intersects(s))
+            return;
+        bool inside = region.contains(s);
+        if (n.is_tile()) {
+            batch.fill(t * (inside ? Box{s} : Box{s} & region),
+                       turn(n.tile()));
+            return;
+        }
+        if (inside) {
+            Box d = t * Box{s};
+            if (graftable(d) && complete(n)) {
+                grafts.emplace_back(d.sbox(), turn(n));
+                return;
+            }
+        }
+        for (auto i: ioct::all())
+            visit(n.branch()[i], s.leaf(i));
+    }
+};
+
+}
+
+void
+View::copy(const View& from) const
+{
+    assert(!from.world);
+    Box m = model_box() & from.model_box();
+    if (m.empty())
+        return;
+    iloc t = l * ~from.l;
+    iloc r = iloc{-(t * ivec3(0)), {}} * t;
+    RegionCopy c{from.l * m, t, r, r * ivec3(1, 2, 4) != ivec3(1, 2, 4),
+                 world ? 0 : grid->size()};
+    c.visit(from.grid->root, SBox{from.grid->size()});
+
+    for (auto& g: c.grafts)
+        grid->top().graft(g.first, std::move(g.second));
+    apply(c.batch);
+}
 
 #ifndef NDEBUG
 void
@@ -2,29 +2,43 @@
 #define CORE_GRID_H
 
 #include "box.h"
+#include "morton.h"
 #include "tile.h"
 
 #include <pgamecc.h>
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <experimental/optional>
 #include <functional>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <stack>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
 
 #include <glm/glm.hpp>
 
 using std::alignment_of;
+using std::atomic;
+using std::deque;
 using std::exchange;
 using std::function;
 using std::list;
 using std::pair;
+using std::shared_ptr;
+using std::size_t;
 using std::stack;
 using std::unique_ptr;
+using std::vector;
+using std::experimental::optional;
 using boost::noncopyable;
 using pgamecc::ivec3;
 using pgamecc::iloc;
@@ -35,6 +49,7 @@ using pgamecc::dloc;
 // rather than what is pointed to.
 
 class Branch;
+class Grid;
 
 // TODO: check whether this is moveable, and required to be moveable
 class Node : noncopyable {
@@ -47,9 +62,10 @@ class Node : noncopyable {
     // Chosen this way so branch pointer masking is not required.
     // Simple tiles need to be masked anyway to get different parts.
     // In the future there may be another kind of pointer for complex tiles.
-    // Branches are pointers and owned by us.
-    // Empty is a kind of tile. Null means unknown, to be used in future for
-    // overlays.
+    // Branches are pointers and owned by us, together with any other nodes
+    // that share them (see Branch::shared).
+    // Empty is a kind of tile. Null means unknown; in an overlay it shows
+    // whatever the grid below has there (see Grid::merge).
 
     // Can't test this statically, but assume that nullptr has bit 0 clear due
     // to allignment restriction and so never interferes with tile data space.
@@ -120,6 +136,14 @@ public:
         clear();
     }
 
+    // another reference to the same tile or branch
+    Node share() const; // defined below
+
+    // same tile or same branch
+    bool operator==(const Node& r) const { return data == r.data; }
+    bool operator!=(const Node& r) const { return data != r.data; }
+    size_t hash() const { return std::hash<data_type>()(data); }
+
     bool is_null() const {
         return is_pointer() && !get_pointer();
     }
@@ -148,19 +172,112 @@ public:
 };
 
 
+// What is below a branch, so that queries can skip whole subtrees without
+// descending. Edits recompute it on their way back up, see Branch::summarize.
+// An editing cursor that descends past a branch clears valid, since whatever it
+// then changes below won't come back up; an invalid summary says nothing and
+// is recomputed by the next edit above it.
+
+// A null child may show anything through an overlay, so it counts as occupied,
+// not solid, shaped and of any hp.
+
+struct BranchSummary {
+    uint32_t occupied : 8; // children with non-empty tiles
+    uint32_t solid : 8; // children made entirely of non-empty cubes
+    uint32_t shaped : 1; // any shaped tile below
+    uint32_t min_hp : 3, max_hp : 3; // of non-empty tiles below
+    uint32_t valid : 1;
+
+    // children that may have non-empty tiles
+    int maybe_occupied() const { return valid ? occupied : 0xff; }
+};
+
+
 // A node in the octree.
 
 class Branch {
     Node child[8];
 
 public:
-    explicit Branch() : child{} {}
-    explicit Branch(Tile t) : child{t, t, t, t, t, t, t, t} {}
+    explicit Branch() : child{} { summarize(); }
+    explicit Branch(Tile t) : child{t, t, t, t, t, t, t, t} { summarize(); }
 
     Node& operator[](ioct i) {
         assert(i.i() >= 0 && i.i() < 8);
         return child[i.i()];
     }
+
+    // A branch can be referenced by more than one node, in which case it is
+    // shared and must not be modified: an edit below it first replaces the
+    // referencing node with an unshared copy(), so edits copy only the path
+    // from the root. Counts are kept by BranchPool, so that a branch remains
+    // one cache line. Defined below.
+    void ref() const;
+    bool unref() const; // true when that was the last reference
+    bool shared() const;
+    unique_ptr<Branch> copy() const; // children shared
+
+    // Also kept by BranchPool. summarize() recomputes it from the children,
+    // and invalid summaries of unshared branches below.
+    const BranchSummary& summary() const;
+    void summarize();
+    void invalidate();
+
+    // allocated from BranchPool, never individually on the heap
+    static void* operator new(size_t);
+    static void operator delete(void*);
+};
+
+
+// Storage for all branches. Branches are carved out of large slabs so that an
+// octree isn't scattered across the heap in millions of small blocks, and
+// branches subdivided together end up close together in memory. Each branch
+// takes exactly one cache line. Freed branches are kept for reuse; slabs are
+// never returned to the system.
+
+// The pool is shared by all grids since a Node has no way back to its Grid.
+// Each thread keeps a short list of free branches, so the shared list is only
+// locked once per batch.
+
+// Slabs are aligned to their size and begin with a header for each of their
+// branches, holding its reference count and summary, so these are found from
+// a branch's address alone.
+
+class BranchPool {
+public:
+    struct Header {
+        atomic<uint32_t> refs;
+        BranchSummary summary;
+    };
+
+    enum : size_t {
+        cache_line = 64,
+        slab_bytes = 65536,
+        // headers for the remaining lines fit in the lines before them
+        header_lines = 114,
+        slab_branches = slab_bytes / cache_line - header_lines,
+    };
+    static_assert(header_lines * cache_line / sizeof(Header) >= slab_branches,
+                  "not enough room for headers");
+
+    struct Stats {
+        size_t slabs;
+        size_t branches; // live
+        size_t bytes; // resident in slabs
+    };
+
+    static void* allocate(); // with one reference
+    static void release(void*);
+    static Stats stats();
+
+    static Header& header(const void* branch) {
+        auto a = reinterpret_cast<uintptr_t>(branch);
+        auto headers = reinterpret_cast<Header*>(a & -slab_bytes);
+        return headers[(a & slab_bytes - 1) / cache_line - header_lines];
+    }
+    static atomic<uint32_t>& refs(const void* branch) {
+        return header(branch).refs;
+    }
 };
 
 
@@ -172,11 +289,212 @@ static_assert(
 inline void
 Node::clear()
 {
-    if (is_branch())
+    if (is_branch() && branch().unref())
         delete &branch();
     // now overwrite data
 }
 
+inline Node
+Node::share() const
+{
+    if (is_branch())
+        branch().ref();
+    return Node(data);
+}
+
+inline void
+Branch::ref() const
+{
+    BranchPool::refs(this).fetch_add(1, std::memory_order_relaxed);
+}
+
+inline bool
+Branch::unref() const
+{
+    return BranchPool::refs(this).fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+inline bool
+Branch::shared() const
+{
+    return BranchPool::refs(this).load(std::memory_order_acquire) > 1;
+}
+
+inline unique_ptr<Branch>
+Branch::copy() const
+{
+    unique_ptr<Branch> b(new Branch());
+    for (int i = 0; i < 8; i++)
+        b->child[i] = child[i].share();
+    BranchPool::header(b.get()).summary = summary();
+    return b;
+}
+
+inline const BranchSummary&
+Branch::summary() const
+{
+    return BranchPool::header(this).summary;
+}
+
+inline void
+Branch::invalidate()
+{
+    BranchPool::header(this).summary.valid = 0;
+}
+
+
+
+// Record of edits to a grid, so that whatever depends on the grid can find out
+// what changed since it last looked instead of going over all of it. Each edit
+// gets the next generation number. Only recent edits are kept; asking about
+// anything older reports the whole area as changed, as does asking about a
+// generation from before the grid was replaced.
+
+// Generation numbers are drawn from one counter for all journals, and a new
+// journal starts after every number drawn so far. A generation kept from a
+// grid that has since been replaced, as by assigning a new or unpacked grid,
+// is then older than anything the new journal knows about.
+
+class GridJournal {
+    struct Entry {
+        uint64_t generation;
+        Box b;
+    };
+    deque<Entry> entries;
+    uint64_t _generation = ++counter;
+    uint64_t forgotten = _generation; // last generation no longer in entries
+
+    enum { capacity = 4096 };
+
+    static atomic<uint64_t> counter;
+
+public:
+    uint64_t generation() const { return _generation; }
+
+    void record(Box b) {
+        entries.push_back({ _generation = ++counter, b });
+        if (entries.size() > capacity) {
+            forgotten = entries.front().generation;
+            entries.pop_front();
+        }
+    }
+
+    // Boxes edited after generation since, clipped to bound, newest first.
+    // They may overlap.
+    void each_change(uint64_t since, Box bound, function<void(Box)>) const;
+    bool changed(uint64_t since, Box bound) const;
+
+    // the same as one region, where what was edited more than once is there
+    // only once
+    BoxSet changed_region(uint64_t since, Box bound) const {
+        BoxSet r;
+        each_change(since, bound, [&] (Box b) { r.add(b); });
+        r.coalesce();
+        return r;
+    }
+
+    // same generation, but no record of earlier edits
+    GridJournal fork() const {
+        GridJournal j;
+        j._generation = j.forgotten = _generation;
+        return j;
+    }
+};
+
+
+// Result of a ray cast, see ConstCursor::raycast.
+
+struct RayHit {
+    dvec3 p;
+    dvec3 normal; // zero if the ray starts inside the tile
+    double distance;
+    SBox box;
+    Tile tile;
+};
+
+
+// Rays with the same direction and length, cast together, see
+// ConstCursor::raycast. Each node is tested against all rays still in play at
+// once, with the per-ray arithmetic laid out for the compiler to vectorize.
+
+namespace detail { class ConstCursor; }
+
+class RayPacket {
+public:
+    enum { max_rays = 64 };
+
+private:
+    dvec3 d, inv;
+    double length;
+    int n = 0;
+    double o[3][max_rays]; // origins by axis
+    optional<RayHit> hits[max_rays];
+
+    friend class detail::ConstCursor;
+
+public:
+    RayPacket(dvec3 direction, double length);
+
+    int add(dvec3 origin) { // returns index
+        assert(n < max_rays);
+        for (int a = 0; a < 3; a++)
+            o[a][n] = origin[a];
+        hits[n] = {};
+        return n++;
+    }
+
+    int size() const { return n; }
+    void clear() { n = 0; }
+
+    // unit cells that any of the rays may pass through
+    Box bound() const;
+
+    const optional<RayHit>& operator[](int i) const {
+        assert(i >= 0 && i < n);
+        return hits[i];
+    }
+};
+
+
+// A batch of edits to be applied to the grid together. They are applied in a
+// single descent, each node passing on to a child only the edits that reach
+// it, so a batch of many small fills costs roughly the number of nodes touched
+// rather than the number of edits times the depth. Where edits overlap, later
+// ones take precedence, as if they were issued in sequence.
+
+namespace detail { class Cursor; }
+
+class EditBatch {
+    struct Edit {
+        Box b;
+        Tile t;
+        unsigned seq; // order added
+    };
+    vector<Edit> edits;
+
+public:
+    void fill(Box b, Tile t) {
+        if (!b.empty())
+            edits.push_back({ b, t, static_cast<unsigned>(edits.size()) });
+    }
+    void cut(Box b) { fill(b, Tile::empty()); }
+
+    bool empty() const { return edits.empty(); }
+    size_t size() const { return edits.size(); }
+    void clear() { edits.clear(); }
+
+    // tile of the last edit that reaches into b, if any
+    optional<Tile> last(Box b) const {
+        for (auto e = edits.rbegin(); e != edits.rend(); ++e)
+            if (e->b.intersects(b))
+                return e->t;
+        return {};
+    }
+
+    friend class detail::Cursor;
+    friend class World;
+};
+
 
 
 // Cursor is used to access and transform the octree. It is a wrapper for a Node
@@ -195,7 +513,10 @@ public:
 
     static SBox containing_sbox(SBox);
 
-    static bool coord_less(ivec3, ivec3);
+    // traversal order, see Morton
+    static bool coord_less(ivec3 a, ivec3 b) {
+        return Morton(a) < Morton(b);
+    }
     struct CoordLess {
         bool operator()(ivec3 a, ivec3 b) const {
             return CursorCommon::coord_less(a, b);
@@ -203,22 +524,134 @@ public:
     };
 };
 
+// Forward range over the non-empty tiles under a node that intersect a bound,
+// as (SBox, Tile) pairs in coord_less order. Subtrees outside the bound are
+// skipped. The iterator keeps its own stack, so a loop over it can stop at
+// any point.
+
+template<typename Node>
+class TileRange_ {
+    Node& root;
+    SBox s;
+    Box bound;
+
+public:
+    class iterator {
+        struct Frame {
+            Node* node; // branch whose children are being visited
+            ivec3 p;
+            int size;
+            int next; // child
+            int occupied; // children with anything to visit
+        };
+        Frame stack[sizeof(int) * 8];
+        int depth = 0;
+        Box bound;
+        SBox box{0};
+        Tile tile;
+
+        void advance() {
+            while (depth) {
+                Frame& f = stack[depth-1];
+                if (f.next == 8) {
+                    depth--;
+                    continue;
+                }
+                ioct i{f.next++};
+                int h = f.size / 2;
+                SBox c = f.p + i * h + SBox{h};
+                auto& n = f.node->branch()[i];
+                if (!(f.occupied >> i.i() & 1) || !bound.intersects(c))
+                    continue;
+                if (n.is_branch())
+                    stack[depth++] = { &n, c.p0(), h, 0,
+                                       n.branch().summary().maybe_occupied() };
+                else if (n.is_tile() && n.tile()) {
+                    box = c;
+                    tile = n.tile();
+                    return;
+                }
+            }
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef pair<SBox, Tile> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef value_type reference;
+
+        explicit iterator(Box bound) : bound(bound) {} // end
+
+        iterator(Node& root, SBox s, Box bound) : bound(bound) {
+            if (!bound.intersects(s))
+                return;
+            // a tile at the root is current with nothing left to visit
+            stack[depth++] = { &root, s.p0(), s.size(),
+                               root.is_branch() ? 0 : 8,
+                               root.is_branch() ?
+                                   root.branch().summary().maybe_occupied() :
+                                   0 };
+            if (root.is_branch())
+                advance();
+            else if (root.is_tile() && root.tile()) {
+                box = s;
+                tile = root.tile();
+            } else
+                depth = 0;
+        }
+
+        value_type operator*() const { return { box, tile }; }
+
+        iterator& operator++() {
+            advance();
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator r = *this;
+            advance();
+            return r;
+        }
+
+        bool operator==(const iterator& r) const {
+            return depth == r.depth &&
+                   (!depth || stack[depth-1].node == r.stack[depth-1].node &&
+                              stack[depth-1].next == r.stack[depth-1].next);
+        }
+        bool operator!=(const iterator& r) const { return !(*this == r); }
+    };
+
+    TileRange_(Node& root, SBox s, Box bound) :
+        root(root), s(s), bound(bound) {}
+
+    iterator begin() const { return { root, s, bound }; }
+    iterator end() const { return iterator(bound); }
+};
+
 template<typename Derived, typename Node>
 class CursorBase_ : public CursorCommon {
 private:
-    Derived copy() const { return { node, s }; }
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+    Derived copy() const { return self().derive(node, s); }
 
 protected:
     typedef CursorBase_ CursorBase;
 
     Node& node;
 
+    // cursor for another node, see Cursor::derive
+    Derived derive(Node& n, SBox b) const { return { n, b }; }
+
+    // how to get from a branch to its child, see Cursor::child
+    template<typename N>
+    static auto& child(N& n, ioct i) { return n.branch()[i]; }
+
 public:
     CursorBase_(Node& node, SBox s) : CursorCommon(s), node(node) {}
 
     Derived operator[](ioct i) const {
         assert(is_branch());
-        return { node.branch()[i], s.leaf(i) };
+        return self().derive(Derived::child(node, i), s.leaf(i));
     }
 
     Derived find(SBox b) const {
@@ -240,15 +673,71 @@ public:
     bool is_branch() const { return node.is_branch(); }
     bool is_tile() const { return node.is_tile(); }
     Tile tile() const { return node.tile(); }
+
+    // see BranchSummary
+    BranchSummary summary() const { return node.branch().summary(); }
+    int occupied() const { return summary().maybe_occupied(); }
+
+    // Answered from the summary where the node is a branch, so false may only
+    // mean not known.
+    bool is_vacant() const { // no non-empty tiles
+        return is_tile() ? !tile() :
+               is_null() || summary().valid && !summary().occupied;
+    }
+    bool is_solid() const { // only non-empty cubes
+        return is_tile() ? tile() && !tile().shape() :
+               is_branch() && summary().valid && summary().solid == 0xff;
+    }
+    bool is_unshaped() const { // no shaped tiles
+        return is_tile() ? !tile().shape() :
+               is_null() || summary().valid && !summary().shaped;
+    }
+
+    // Call f(SBox, Tile) for each non-empty tile intersecting bound. Used by
+    // Island to map tiles to ODE boxes. Order is fixed as defined by
+    // coord_less. A template so the callback can be inlined.
+    // NOTE: client code may expect this to iterate over complete tiles;
+    // investigate before changing this to subdivide by bound
+    template<typename F>
+    void each_tile(Box bound, F&& f) const {
+        if (bound.intersects(s))
+            if (is_branch()) {
+                int m = occupied();
+                for (auto i: ioct::all())
+                    if (m >> i.i() & 1)
+                        (*this)[i].each_tile(bound, f);
+            }
+            else if (is_tile())
+                if (Tile t = tile())
+                    f(s, t);
+    }
+
+    // same tiles as each_tile() as a range
+    TileRange_<Node> tiles(Box bound) const { return { node, s, bound }; }
 };
 
 class ConstCursor : public CursorBase_<ConstCursor, const Node> {
     using CursorBase::CursorBase;
 
+    optional<RayHit> raycast(dvec3 origin, dvec3 direction, double length,
+                             const ConstCursor* base) const;
+    void raycast(RayPacket&, const ConstCursor* base) const;
+
 public:
-    // Iterate over tiles. Used by Island to map tiles to ODE boxes. Order is
-    // fixed as defined by coord_less.
-    void each_tile(Box bound, function<void(SBox, Tile)>) const;
+    // First non-empty tile along a ray, which has unit length direction, up
+    // to length. Empty space is skipped a whole node at a time, and shaped
+    // tiles are hit where their surface is.
+    optional<RayHit> raycast(dvec3 origin, dvec3 direction,
+                             double length) const;
+
+    // same for each ray in the packet, with one traversal for all of them
+    void raycast(RayPacket&) const;
+
+    // The same through an overlay, where null nodes show base, a cursor for
+    // the same box of the grid below.
+    optional<RayHit> raycast(dvec3 origin, dvec3 direction, double length,
+                             const ConstCursor& base) const;
+    void raycast(RayPacket&, const ConstCursor& base) const;
 
 #ifndef NDEBUG
     void show_text(int indent = 0) const;
@@ -256,30 +745,139 @@ public:
 };
 
 class Cursor : public CursorBase_<Cursor, Node> {
-    using CursorBase::CursorBase;
+    GridJournal* journal; // where edits are recorded, if anywhere
+
+    Cursor derive(Node& n, SBox b) const { return { n, b, journal }; }
 
-    void subdivide() const {
-        if (!is_branch())
+    // also makes sure the branch isn't shared, so its children can be edited
+    static void subdivide(Node& node) {
+        if (!node.is_branch())
             node = unique_ptr<Branch>(
-                is_null() ? new Branch() : new Branch(tile()));
+                node.is_null() ? new Branch() : new Branch(node.tile()));
+        else if (node.branch().shared())
+            node = node.branch().copy();
+    }
+
+    void subdivide() const { subdivide(node); }
+
+    friend CursorBase;
+    static Node& child(Node& n, ioct i) {
+        subdivide(n);
+        n.branch().invalidate();
+        return n.branch()[i];
     }
 
+    struct BranchTable;
+    static void deduplicate_recurse(Node&, BranchTable&);
+
     bool fill_recurse(Box b, Tile t) const;
+    void merge_recurse(Node&, const ConstCursor& overlay) const;
+    static void graft_recurse(Node&, SBox s, SBox b, Node n);
+
+    static void apply_recurse(Node&, SBox, const vector<EditBatch::Edit>&,
+                              vector<unsigned>& list, size_t begin);
+
+    void record(Box b) const {
+        if (journal)
+            journal->record(b);
+    }
 
 public:
-    void cut(Box b) const { fill_recurse(b, Tile::empty()); }
-    void fill(Box b, Tile t) const { fill_recurse(b, t); }
+    Cursor(Node& node, SBox s, GridJournal* journal = nullptr) :
+        CursorBase(node, s), journal(journal) {}
+
+    void cut(Box b) const { fill(b, Tile::empty()); }
+    void fill(Box b, Tile t) const;
+
+    // Straightforward recursive version of fill(), kept as a reference for
+    // tests and benchmarks.
+    void fill_reference(Box b, Tile t) const { fill_recurse(b, t); }
+
+    void apply(const EditBatch&) const;
+
+    // replace the whole node, e.g. with one from GridBuilder
+    void replace(Node n) const {
+        record(s);
+        node = std::move(n);
+    }
+
+    // Replace the node at b, which is aligned to its size, subdividing down
+    // to it and merging what became uniform on the way back up.
+    void graft(SBox b, Node n) const;
+
+    // Replace identical branches with references to one copy, turning the
+    // tree into a DAG. Shared branches are only looked at as a whole; what is
+    // below them stays as it is.
+    void deduplicate() const;
+
+    // Detach the 8^depth subtrees depth levels below into grids of their own,
+    // call f(origin, grid) for each on worker threads, and put them back,
+    // merging what became uniform. Workers share nothing but the branch pool.
+    void split(int depth, const function<void(ivec3, Grid&)>& f) const;
+
+    // Copy what isn't null in overlay, a cursor for the same box of another
+    // grid, into this node.
+    void merge(const ConstCursor& overlay) const;
 };
 
 }
 
 
+// Worker threads for Cursor::split, 0 for one per core.
+extern unsigned split_threads;
+
+
+// What a grid holds, see Grid::stats. Counts are of what is stored: a branch
+// referenced more than once within the grid, as after deduplicate(), is
+// counted once, together with what is below it.
+
+struct GridStats {
+    enum { max_levels = 32 };
+
+    size_t branches = 0;
+    size_t shared = 0; // of those, referenced more than once, here or not
+    size_t branches_at[max_levels] = {}; // by depth below the root
+    size_t leaves_at[max_levels] = {}; // by level, 0 for unit size
+    size_t cubes = 0, shaped = 0, empty = 0, null = 0; // leaves by kind
+    int depth = 0; // of the deepest leaf
+
+    size_t leaves() const { return cubes + shaped + empty + null; }
+
+    // pool memory taken by the branches, including their headers
+    size_t bytes() const {
+        return branches * (sizeof(Branch) + sizeof(BranchPool::Header));
+    }
+
+    // unit cells per leaf, that is how much uniform space was merged
+    double merge_ratio() const;
+
+#ifndef NDEBUG
+    void show() const;
+#endif
+};
+
+
+class View;
+
 // The size of each node is calculated dynamically by the cursor from the value
 // stored for the root node here.
 
 class Grid {
+    friend class detail::Cursor; // for split()
+    friend class View; // for copy()
+
     Node root;
     int _size;
+    GridJournal journal;
+
+    // see generate_lazily()
+    struct Lazy {
+        int chunk;
+        function<void(View)> generator;
+    };
+    shared_ptr<const Lazy> lazy;
+
+    size_t generate_recurse(Node&, SBox, Box);
 
 public:
     using       cursor = detail::Cursor;
@@ -287,10 +885,93 @@ public:
 
     Grid() : _size(1) {} // placeholder grid
     Grid(int size) : _size(size) { assert(size > 0); }
+    Grid(int size, Node root) : root(std::move(root)), _size(size) {
+        assert(size > 0);
+    }
     int size() const { return _size; }
-          cursor top()       { return { root, SBox{_size} }; }
+          cursor top()       { return { root, SBox{_size}, &journal }; }
     const_cursor top() const { return { root, SBox{_size} }; }
     const_cursor ctop() const { return top(); }
+
+    // A copy that is not affected by later edits to this grid. It shares all
+    // branches, so taking it costs nothing, and later edits to either copy
+    // only the branches on the path to what they change. A shared grid can be
+    // read by another thread while this one is edited.
+    Grid share() const {
+        Grid g(_size, root.share());
+        g.journal = journal.fork();
+        g.lazy = lazy;
+        return g;
+    }
+
+    optional<RayHit> raycast(dvec3 origin, dvec3 direction,
+                             double length) const {
+        return ctop().raycast(origin, direction, length);
+    }
+    void raycast(RayPacket& packet) const { ctop().raycast(packet); }
+
+    // Queries through this grid as an overlay of base, see merge().
+    optional<RayHit> raycast(dvec3 origin, dvec3 direction, double length,
+                             const Grid& base) const {
+        assert(base.size() == _size);
+        return ctop().raycast(origin, direction, length, base.ctop());
+    }
+    void raycast(RayPacket& packet, const Grid& base) const {
+        assert(base.size() == _size);
+        ctop().raycast(packet, base.ctop());
+    }
+
+    // edits made through top(), see GridJournal
+    const GridJournal& changes() const { return journal; }
+
+    // goes over the whole tree
+    GridStats stats() const;
+
+    // A lazily generated grid is painted a chunk at a time, a chunk being an
+    // aligned cube of the given size. Chunks start out null, which queries
+    // take as empty, and each is painted by generator the first time
+    // generate() is asked for a box that intersects it. The generator is
+    // given a view of the chunk alone, in grid coordinates as World gives one
+    // of a page, and must paint it the same whatever was generated before.
+    // Nothing generates by itself: what is about to read or edit a box asks
+    // for it first, as Island::sync does for its region and Level for what
+    // is around the camera.
+    void generate_lazily(int chunk, function<void(View)> generator);
+    bool is_lazy() const { return bool(lazy); }
+
+    // Generate the chunks intersecting b that are still null, each recorded
+    // as an edit, and return how many there were. Space that is already
+    // there is only looked at, so this can be called every step.
+    size_t generate(Box b);
+
+    void apply(const EditBatch& batch) { top().apply(batch); }
+
+    // Share identical subtrees. Edits still work as usual; they copy the
+    // shared branches on the path to what they change.
+    void deduplicate() { top().deduplicate(); }
+
+    // A grid of the aligned box b alone, sharing what this grid has there
+    // as share() does.
+    Grid part(SBox b) const;
+
+    // Same size and the same tree, as after one was copied from the other
+    // by part() or View::copy, unless either was edited since.
+    bool same(const Grid& r) const {
+        return _size == r._size && root == r.root;
+    }
+
+    void split(int depth, const function<void(ivec3, Grid&)>& f) {
+        top().split(depth, f);
+    }
+
+    // A new grid starts out null, which as an overlay of another grid of the
+    // same size shows all of that grid. Edits to the overlay stay in it, and
+    // replace what is below where they are, until merged into the grid below:
+    // its tiles are copied over, and what is still null is left as it was.
+    void merge(const Grid& overlay) {
+        assert(overlay.size() == _size);
+        top().merge(overlay.ctop());
+    }
 };
 
 
@@ -301,32 +982,61 @@ public:
 // The initial view matches grid coordinates, with the origin at the base (lower
 // corner) of the grid.
 
+// A view can also be of a World, in which case grid coordinates are world
+// coordinates and edits go to whichever pages they fall in.
+
+class World;
+struct BuildBlock;
+
 class View {
     Grid* grid; // pointer so View can be assigned to
+    World* world; // instead of grid
     Box b; // model coordinates
     iloc l; // model to grid transform
 
-    View(Grid* grid, Box b, iloc l) :
-        grid(grid), b(b), l(l) {}
+    View(Grid* grid, World* world, Box b, iloc l) :
+        grid(grid), world(world), b(b), l(l) {}
 
     View set_model_box(Box m) const {
         assert(b.contains(m));
-        return { grid, m, l };
+        return { grid, world, m, l };
     }
 
     View set_location(iloc r) const {
-        View v(grid, ~r * l * b, r);
+        View v(grid, world, ~r * l * b, r);
         assert(v.grid_box() == grid_box());
         return v;
     }
 
+    // defined in world.cc
+    void world_fill(Tile) const;
+    void world_apply(const EditBatch&) const;
+    // loaded pages intersecting the grid box, with their origins
+    vector<pair<ivec3, const Grid*>> world_pages() const;
+
+    template<typename F>
+    void world_each_tile(F&& f) const {
+        for (auto& p: world_pages())
+            p.second->ctop().each_tile(
+                grid_box() - p.first,
+                [&] (SBox s, Tile t) { f(s + p.first, t); });
+    }
+
 public:
     View(Grid& grid) :
         grid(&grid),
+        world(nullptr),
         b(SBox{grid.size()})
     {
     }
 
+    View(World& world, Box b) :
+        grid(nullptr),
+        world(&world),
+        b(b)
+    {
+    }
+
     Box model_box() const { return b; }
     Box grid_box() const { return l * b; }
 
@@ -375,20 +1085,67 @@ public:
     // operations (edit tiles in grid box)
 
     void cut() const {
-        grid->top().cut(grid_box());
+        fill(Tile::empty());
     }
 
     void fill(Tile t) const {
-        grid->top().fill(grid_box(), t);
+        if (world)
+            world_fill(t);
+        else
+            grid->top().fill(grid_box(), t);
+    }
+
+    // record instead of editing immediately
+    void cut(EditBatch& batch) const { batch.cut(grid_box()); }
+    void fill(Tile t, EditBatch& batch) const { batch.fill(grid_box(), t); }
+
+    void apply(const EditBatch& batch) const {
+        if (world)
+            world_apply(batch);
+        else
+            grid->apply(batch);
     }
 
+    // Paint in parallel, see Cursor::split. f(part, m) is called for each
+    // subtree that this view reaches, with m the model box of the view inside
+    // that subtree. The part has the same model box and coordinates, but its
+    // grid is only that subtree: edits outside it are dropped and reads see
+    // nothing there. A view of a world is painted as one part.
+    void parallel(int depth, const function<void(View, Box)>& f) const;
+
+    // Copy what from has at each model coordinate of both views to the same
+    // model coordinate here, with shaped tiles turned as the views are to
+    // each other. Null in from is left out, so a prefab painted into a new
+    // grid only brings what was painted. Subtrees of from that land on whole
+    // aligned nodes of a grid are grafted rather than copied tile by tile,
+    // and shared if the views aren't turned relative to each other, so that
+    // stamping a prefab costs about as much as the nodes along its surface.
+    // from can be of the same grid, and is read before anything is written.
+    // It can't be of a world.
+    void copy(const View& from) const;
+
+    // Paint by building the grid bottom-up, see GridBuilder::add_blocks, with
+    // f(m) telling what model box m becomes. Only done where the grid is all
+    // one tile, which becomes the background, as a part of a grid being
+    // generated often is; returns false otherwise, having done nothing.
+    bool build(const function<BuildBlock(Box)>& f) const;
+
 
     // queries
 
     // model to grid
     dloc location(dloc p) { return l.dloc_cast() * p; }
 
-    void each_tile(function<void(SBox, Tile)>) const;
+    // tiles in model coordinates
+    template<typename F>
+    void each_tile(F&& f) const {
+        iloc r = ~l;
+        auto model = [&] (SBox s, Tile t) { f((r * Box{s}).sbox(), t); };
+        if (world)
+            world_each_tile(model);
+        else
+            grid->ctop().each_tile(grid_box(), model);
+    }
 
 #ifndef NDEBUG
     void show_oblique() const;
@@ -1,19 +1,145 @@
 #include "level.h"
 
+#include "packed.h"
+#include "snapshot.h"
+
+#include <cstdlib>
 #include <map>
+#include <memory>
 #include <tuple>
 
+#include <sys/stat.h>
+
 using std::map;
 using std::get;
 using std::tuple;
 
 
+Level::~Level()
+{
+    if (world)
+        unload_pages({});
+}
+
+
 void
 Level::step()
 {
     before_step();
     sea.step(grid);
     after_step();
+    if (grid.is_lazy())
+        grid.generate(around_camera());
+    if (world)
+        focus_world();
+    publish();
+}
+
+Box
+Level::around_camera() const
+{
+    return ivec3(camera.l.p) - view_distance + Box{ivec3(2 * view_distance)};
+}
+
+
+void
+Level::use_world(int size, unique_ptr<World> w)
+{
+    world = std::move(w);
+    assert(size % world->page_size() == 0);
+    grid = Grid(size);
+    grid.generate_lazily(world->page_size(), [this] (View v) {
+        // model coordinates are those of the window, and so of the world
+        ivec3 origin = v.model_box().p0();
+        v.copy(View(world->grid(world->page_of(origin))).translate(-origin));
+    });
+}
+
+void
+Level::focus_world()
+{
+    Box all{ivec3(grid.size())};
+    ivec3 margin(world->page_size());
+    auto around = [&] (Box b) { return b.trim(-margin, -margin) & all; };
+    vector<Box> areas{ around(around_camera()) };
+    for (auto island: sea.all())
+        areas.push_back(around(island->bound));
+    unload_pages(areas);
+}
+
+void
+Level::unload_pages(const vector<Box>& keep)
+{
+    world->focus(keep, [&] (ivec3 p, Grid& page) {
+        SBox b = world->page_box(p);
+        Grid part = grid.part(b);
+        if (part.ctop().is_null())
+            return; // never copied into the grid
+        if (!part.same(page))
+            page = std::move(part); // saved on unload, see World::focus
+        grid.top().graft(b, Node()); // copied in again when next needed
+    });
+}
+
+void
+Level::publish()
+{
+    // Only ours and the one in published are held once the render thread has
+    // moved on, and a copy in use can't be picked up again meanwhile, since
+    // it is no longer published.
+    shared_ptr<PackedGrid> p;
+    for (auto& q: packed)
+        if (q.use_count() == 1)
+            p = q;
+    if (p)
+        p->update(grid);
+    else {
+        p = std::make_shared<PackedGrid>(grid);
+        packed.push_back(p);
+    }
+    std::atomic_store(&published, shared_ptr<const PackedGrid>(p));
+}
+
+
+bool
+Level::load_grid(const string& name, uint64_t key)
+{
+    string dir = cache_dir();
+    if (dir.empty())
+        return false;
+    GridSnapshot snapshot(dir + "/" + name, key);
+    if (snapshot)
+        grid = snapshot.unpack();
+    return bool(snapshot);
+}
+
+void
+Level::save_grid(const string& name, uint64_t key) const
+{
+    // failure only means the grid is generated again next time
+    string dir = cache_dir();
+    if (!dir.empty())
+        GridSnapshot::save(dir + "/" + name, PackedGrid(grid), key);
+}
+
+string
+Level::cache_dir(const string& name)
+{
+    string dir;
+    if (const char* xdg = getenv("XDG_CACHE_HOME"))
+        dir = xdg;
+    else if (const char* home = getenv("HOME"))
+        dir = string(home) + "/.cache";
+    else
+        return {};
+    mkdir(dir.c_str(), 0755); // fails if it exists, which is fine
+    dir += "/turbostomp";
+    mkdir(dir.c_str(), 0755);
+    if (!name.empty()) {
+        dir += "/" + name;
+        mkdir(dir.c_str(), 0755);
+    }
+    return dir;
 }
 
 
@@ -4,15 +4,23 @@
 #include "camera.h"
 #include "control.h"
 #include "grid.h"
+#include "packed.h"
 #include "sea.h"
+#include "world.h"
 
+#include <cstdint>
 #include <functional>
 #include <list>
+#include <memory>
 #include <string>
+#include <vector>
 
 using std::function;
 using std::list;
+using std::shared_ptr;
 using std::string;
+using std::unique_ptr;
+using std::vector;
 
 class Camera;
 class Controls;
@@ -28,12 +36,53 @@ protected:
     Camera camera;
     Controls controls;
 
+    // For a lazily generated grid (see Grid::generate_lazily), chunks within
+    // this distance of the camera are generated before each publish().
+    int view_distance = 256;
+    Box around_camera() const;
+
+    // A level can be set in a world rather than a grid of its own. The grid
+    // is then a window on world coordinates 0 to its size, generated lazily
+    // a page at a time by copying the page in, which shares its branches.
+    // After each step, pages more than a page away from the camera area and
+    // from every island are unloaded, with what was edited in the grid going
+    // back to the page, so that only the pages in use are kept in memory.
+    unique_ptr<World> world;
+    void use_world(int size, unique_ptr<World>);
+    void focus_world();
+    void unload_pages(const vector<Box>& keep); // see World::focus
+
+    // Latest grid published by step() for the render thread, packed so that
+    // drawing goes forward through one array. Replaced atomically, and a
+    // reader's copy stays valid until it's done with it. Packed grids no
+    // reader holds any more are brought up to date from the journal and
+    // published again, rather than packing the whole grid each step.
+    shared_ptr<const PackedGrid> published;
+    vector<shared_ptr<PackedGrid>> packed;
+    void publish();
+
+    // Cache for generated grids, see GridSnapshot, as files of the given
+    // name in cache_dir(). load_grid() replaces the grid and returns true if
+    // the file has a snapshot with the given key.
+    bool load_grid(const string& name, uint64_t key);
+    void save_grid(const string& name, uint64_t key) const;
+
+    // $XDG_CACHE_HOME/turbostomp, or ~/.cache/turbostomp, or a directory of
+    // the given name in it, created if needed; empty if there is neither
+    static string cache_dir(const string& name = {});
+
 public:
+    virtual ~Level(); // unloads the world's pages, if any, saving edits
+
     virtual void generate() = 0;
     virtual void before_step() = 0;
     virtual void after_step() = 0;
     void step();
 
+    shared_ptr<const PackedGrid> published_grid() const {
+        return std::atomic_load(&published);
+    }
+
     struct catalogue {
         catalogue(int priority, string name, function<Level*()> factory);
 
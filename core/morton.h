@@ -0,0 +1,85 @@
+#ifndef CORE_MORTON_H
+#define CORE_MORTON_H
+
+#include <cassert>
+#include <cstdint>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+
+// Morton (Z-order) key of a grid coordinate: the bits of x, y and z
+// interleaved, x lowest. Each group of three bits is the ioct index of the
+// child containing the coordinate at that level of the octree, so keys compare
+// in the order in which the grid is recursively traversed, and comparing two
+// coordinates is a single integer comparison.
+
+// Only depends on glm so that misc/coord_less.cc can check it standalone.
+
+class Morton {
+    uint64_t k;
+
+    explicit Morton(uint64_t k) : k(k) {}
+
+    static uint64_t spread(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x001f00000000ffff;
+        v = (v | v << 16) & 0x001f0000ff0000ff;
+        v = (v | v <<  8) & 0x100f00f00f00f00f;
+        v = (v | v <<  4) & 0x10c30c30c30c30c3;
+        v = (v | v <<  2) & 0x1249249249249249;
+        return v;
+    }
+
+    static uint64_t compact(uint64_t v) {
+        v &= 0x1249249249249249;
+        v = (v ^ v >>  2) & 0x10c30c30c30c30c3;
+        v = (v ^ v >>  4) & 0x100f00f00f00f00f;
+        v = (v ^ v >>  8) & 0x001f0000ff0000ff;
+        v = (v ^ v >> 16) & 0x001f00000000ffff;
+        v = (v ^ v >> 32) & 0x1fffff;
+        return v;
+    }
+
+public:
+    enum { bits = 21 }; // per axis
+
+    explicit Morton(glm::ivec3 p) {
+        assert(glm::all(glm::greaterThanEqual(p, glm::ivec3(0))) &&
+               glm::all(glm::lessThan(p, glm::ivec3(1 << bits))));
+#ifdef __BMI2__
+        k = _pdep_u64(p.x, 0x1249249249249249) |
+            _pdep_u64(p.y, 0x2492492492492492) |
+            _pdep_u64(p.z, 0x4924924924924924);
+#else
+        k = spread(p.x) | spread(p.y) << 1 | spread(p.z) << 2;
+#endif
+    }
+
+    static Morton from_key(uint64_t k) { return Morton(k); }
+
+    uint64_t key() const { return k; }
+
+    glm::ivec3 coord() const {
+#ifdef __BMI2__
+        return glm::ivec3(_pext_u64(k, 0x1249249249249249),
+                          _pext_u64(k, 0x2492492492492492),
+                          _pext_u64(k, 0x4924924924924924));
+#else
+        return glm::ivec3(compact(k), compact(k >> 1), compact(k >> 2));
+#endif
+    }
+
+    bool operator==(Morton r) const { return k == r.k; }
+    bool operator!=(Morton r) const { return k != r.k; }
+    bool operator<(Morton r) const { return k < r.k; }
+    bool operator>(Morton r) const { return k > r.k; }
+    bool operator<=(Morton r) const { return k <= r.k; }
+    bool operator>=(Morton r) const { return k >= r.k; }
+};
+
+
+#endif
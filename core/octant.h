@@ -17,6 +17,16 @@ inline ConvexTest operator&(ConvexTest a, ConvexTest b) {
     return static_cast<ConvexTest>(static_cast<int>(a) & static_cast<int>(b));
 };
 
+inline ConvexTest operator|(ConvexTest a, ConvexTest b) {
+    return static_cast<ConvexTest>(static_cast<int>(a) | static_cast<int>(b));
+};
+
+// the test for what is not in the shape: inside and outside swap
+inline ConvexTest operator~(ConvexTest a) {
+    return a == ConvexTest::partial ? a : static_cast<ConvexTest>(
+        3 ^ static_cast<int>(a));
+};
+
 
 template<int N>
 struct Convex {
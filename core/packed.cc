@@ -0,0 +1,97 @@
+#include "packed.h"
+
+#include <cassert>
+#include <utility>
+
+
+Node
+detail::PackedCursor::unpack() const
+{
+    if (is_tile())
+        return tile();
+    if (is_null())
+        return {};
+    unique_ptr<Branch> b(new Branch());
+    for (auto i: ioct::all())
+        (*b)[i] = (*this)[i].unpack();
+    b->summarize();
+    return std::move(b);
+}
+
+
+PackedGrid::PackedGrid(const Grid& grid) :
+    nodes(1), _size(grid.size()), generation(grid.changes().generation())
+{
+    emit(0, grid.ctop());
+}
+
+// Write node at index, appending its children depth-first. Indices rather than
+// references are used throughout since appending reallocates.
+void
+PackedGrid::emit(size_t at, Grid::const_cursor cursor)
+{
+    if (cursor.is_tile())
+        nodes[at] = PackedNode(cursor.tile());
+    else if (cursor.is_null())
+        nodes[at] = PackedNode();
+    else {
+        size_t block = nodes.size();
+        nodes.resize(block + 8);
+        nodes[at] = PackedNode::from_offset(block - at);
+        for (auto i: ioct::all())
+            emit(block + i.i(), cursor[i]);
+    }
+}
+
+size_t
+PackedGrid::count(size_t at) const
+{
+    if (!nodes[at].is_branch())
+        return 0;
+    size_t block = at + nodes[at].offset(), n = 8;
+    for (int i = 0; i < 8; i++)
+        n += count(block + i);
+    return n;
+}
+
+// A branch that is still a branch keeps its block and only the children are
+// updated, so unchanged siblings stay where they are.
+void
+PackedGrid::update(size_t at, Grid::const_cursor cursor, Box dirty)
+{
+    if (!dirty.intersects(cursor.box()))
+        return;
+    if (nodes[at].is_branch() && cursor.is_branch()) {
+        size_t block = at + nodes[at].offset();
+        for (auto i: ioct::all())
+            update(block + i.i(), cursor[i], dirty);
+    } else {
+        garbage += count(at);
+        emit(at, cursor);
+    }
+}
+
+void
+PackedGrid::update(const Grid& grid, Box dirty)
+{
+    assert(grid.size() == _size);
+    if (dirty.empty())
+        return;
+    update(0, grid.ctop(), dirty);
+    if (garbage > nodes.size() / 2)
+        *this = PackedGrid(grid);
+}
+
+void
+PackedGrid::update(const Grid& grid)
+{
+    if (grid.size() != _size) { // replaced by another grid
+        *this = PackedGrid(grid);
+        return;
+    }
+    // edits often overlap, as when an area is painted over and over
+    grid.changes().changed_region(generation, SBox{_size}).each([&] (Box b) {
+        update(grid, b);
+    });
+    generation = grid.changes().generation();
+}
@@ -0,0 +1,132 @@
+#ifndef CORE_PACKED_H
+#define CORE_PACKED_H
+
+#include "grid.h"
+
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+
+// A read-only copy of a grid in one array. Like a Node, each word is either a
+// tile or a branch, but a branch is stored as the offset from the word itself
+// to a block of 8 child words, so the array contains no pointers and can be
+// copied or mapped from a file as is. Blocks are laid out depth-first, so
+// traversal mostly moves forward through memory. Tiles fit in 32 bits, so a
+// block takes half a cache line.
+
+class PackedBranch;
+
+class PackedNode {
+    typedef uint32_t data_type;
+    data_type data;
+
+    // Representation:
+    //   bit 0: 0 - null or branch
+    //          1 - simple tile, same bits as in Tile
+    //   bits 1-31 for branch: signed offset in words to children, never 0
+    static_assert(Tile::end_bit <= sizeof(data_type) * 8, "");
+
+    explicit PackedNode(data_type data) : data(data) {}
+
+    static PackedNode from_offset(ptrdiff_t offset) {
+        assert(offset && offset >= -(1 << 30) && offset < (1 << 30));
+        return PackedNode(static_cast<data_type>(offset) << 1);
+    }
+
+    ptrdiff_t offset() const {
+        return static_cast<int32_t>(data) >> 1;
+    }
+
+public:
+    PackedNode() : data(0) {}
+    explicit PackedNode(Tile t) : data(static_cast<data_type>(t.data)) {
+        assert(data == t.data);
+    }
+
+    bool is_null() const { return !data; }
+    bool is_branch() const { return data && !(data & 1); }
+    bool is_tile() const { return data & 1; }
+
+    const PackedBranch& branch() const {
+        assert(is_branch());
+        return *reinterpret_cast<const PackedBranch*>(this + offset());
+    }
+
+    Tile tile() const {
+        assert(is_tile());
+        return Tile{data};
+    }
+
+    friend class PackedGrid;
+};
+
+class PackedBranch {
+    PackedNode child[8];
+
+public:
+    const PackedNode& operator[](ioct i) const {
+        assert(i.i() >= 0 && i.i() < 8);
+        return child[i.i()];
+    }
+
+    // not kept, so never valid
+    BranchSummary summary() const { return {}; }
+};
+
+static_assert(sizeof(PackedBranch) == 8 * sizeof(PackedNode), "");
+
+
+namespace detail {
+
+class PackedCursor : public CursorBase_<PackedCursor, const PackedNode> {
+    using CursorBase::CursorBase;
+
+public:
+    // copy of the subtree as ordinary nodes
+    Node unpack() const;
+};
+
+}
+
+
+class PackedGrid {
+    vector<PackedNode> nodes; // root first
+    int _size;
+    size_t garbage = 0; // words no longer reachable
+    uint64_t generation; // of grid changes when last updated
+
+    void emit(size_t at, Grid::const_cursor);
+    void update(size_t at, Grid::const_cursor, Box dirty);
+    size_t count(size_t at) const; // words in subtree below
+
+public:
+    using const_cursor = detail::PackedCursor;
+
+    PackedGrid() : nodes(1), _size(1), generation(0) {} // placeholder grid
+    explicit PackedGrid(const Grid&);
+
+    int size() const { return _size; }
+    const_cursor top() const { return { nodes[0], SBox{_size} }; }
+    const_cursor ctop() const { return top(); }
+
+    // Bring up-to-date with grid after edits inside dirty. Only subtrees that
+    // intersect dirty are repacked; they are appended and the old copies left
+    // in place until there's enough garbage to make repacking it all worth it.
+    void update(const Grid&, Box dirty);
+
+    // same, for whatever the grid's journal says changed since last time,
+    // which is all of it if the grid was replaced
+    void update(const Grid&);
+
+    // expand into an ordinary grid
+    Grid unpack() const { return Grid(_size, top().unpack()); }
+
+    const PackedNode* data() const { return nodes.data(); }
+    size_t words() const { return nodes.size(); }
+    size_t bytes() const { return nodes.size() * sizeof(PackedNode); }
+};
+
+
+#endif
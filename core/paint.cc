@@ -1,14 +1,109 @@
 #include "paint.h"
 
+#include "builder.h"
+
 #include <pgamecc.h>
 
+#include <atomic>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 using pgamecc::dvec2;
 using pgamecc::ivec2;
 using pgamecc::ivec4;
 using pgamecc::make_image;
 using pgamecc::PerlinNoise;
-using pgamecc::distance2;
-namespace entropy = pgamecc::entropy;
+using std::atomic;
+using std::thread;
+using std::vector;
+
+
+// Large painters split the grid into this many levels of subtrees, see
+// View::parallel. 64 parts balance uneven terrain better than 8.
+const int split_depth = 2;
+
+// columns of a part of a base view, each one box high at y = 0 so that its p0()
+// is the column's coordinate as with boxes_y() of the whole view
+static Box::Boxes
+columns(Box m)
+{
+    return Box::ranged(ivec3(m.x0(), 0, m.z0()),
+                       ivec3(m.x1(), 1, m.z1())).boxes_y();
+}
+
+
+// What model box m becomes when painting shape s: filled where the cells'
+// centers are in s, or with smooth, wherever any of their corners are. Asked
+// about smaller blocks only where the test can't tell.
+static BuildBlock
+shape_block(const Shape& s, bool smooth, Box m, Tile t)
+{
+    ConvexTest c = smooth ? s.test(m.p0() * 2, m.p1() * 2)
+                          : s.test(m.p0() * 2 + 1, m.p1() * 2 - 1);
+    if (c == ConvexTest::outside)
+        return BuildBlock{ BuildBlock::background };
+    if (c == ConvexTest::inside)
+        return BuildBlock{ BuildBlock::fill, t };
+    if (m.size() != ivec3(1))
+        return BuildBlock{ BuildBlock::mixed };
+
+    ivec3 u = m.p0();
+    if (!smooth)
+        return s.contains(u * 2 + 1) ? BuildBlock{ BuildBlock::fill, t }
+                                     : BuildBlock{ BuildBlock::background };
+    boct corners{0};
+    for (auto corner: ioct::all())
+        corners[corner] |= s.contains((u + ivec3(corner.bvec3_cast())) * 2);
+    if (!corners)
+        return BuildBlock{ BuildBlock::background };
+    return BuildBlock{ BuildBlock::fill, t.shape(corners) };
+}
+
+// The same blocks as GridBuilder::add_blocks asks about, but halving model
+// boxes of any size, with fills recorded in batch.
+template<typename F>
+static void
+fill_blocks(View v, Box m, F& block, EditBatch& batch)
+{
+    BuildBlock b = block(m);
+    if (b.kind == BuildBlock::fill)
+        v.clip(m).fill(b.tile, batch);
+    else if (b.kind == BuildBlock::mixed) {
+        ivec3 c = m.p0() + m.size() / 2;
+        for (auto i: ioct::all()) {
+            auto high = i.bvec3_cast();
+            Box h = Box::ranged(glm::mix(m.p0(), c, high),
+                                glm::mix(c, m.p1(), high));
+            if (!h.empty())
+                fill_blocks(v, h, block, batch);
+        }
+    }
+}
+
+static void
+paint_shape(View v, const Shape& s, bool smooth, Tile t)
+{
+    auto block = [&] (Box m) { return shape_block(s, smooth, m, t); };
+    if (v.model_box().empty() || v.build(block))
+        return;
+    EditBatch batch;
+    fill_blocks(v, v.model_box(), block, batch);
+    v.apply(batch);
+}
+
+void
+paint::shape(View v, const Shape& s, Tile t)
+{
+    paint_shape(v, s, false, t);
+}
+
+void
+paint::shape_smooth(View v, const Shape& s, Tile t)
+{
+    paint_shape(v, s, true, t);
+}
 
 
 void
@@ -20,11 +115,8 @@ paint::sphere(View v, Tile t)
     int diameter = glm::compMin(size);
     assert(size == ivec3(diameter));
 
-    for (auto u: Box{size}.coords())
-        // calculate with denominator 2: 2*center=size, 2*radius=diameter
-        // use coordinates for center of unit box, i.e. u+.5
-        if (distance2(size, u*2+1) < diameter*diameter)
-            v[u].fill(t);
+    // in half units, center is size and radius is diameter
+    shape(v, Shape::sphere(size, diameter*diameter), t);
 }
 
 void
@@ -38,16 +130,8 @@ paint::sphere_smooth(View v, Tile t)
 
     diameter++; // looks better
 
-    for (auto u: Box{size}.coords()) {
-        boct corners{0};
-        for (auto corner: ioct::all()) {
-            // see sphere() for computation
-            auto v = (u + ivec3(corner.bvec3_cast()))*2;
-            corners[corner] |= distance2(size, v) <= diameter*diameter;
-        }
-        if (corners)
-            v[u].fill(t.shape(corners));
-    }
+    // corners on the sphere are in, see sphere()
+    shape_smooth(v, Shape::sphere(size, diameter*diameter + 1), t);
 }
 
 
@@ -60,9 +144,7 @@ paint::cylinder(View v, Tile t)
     int diameter = glm::compMin(size.xz());
     assert(size.xz() == ivec2(diameter));
 
-    for (auto u: Box{size}.boxes_y())
-        if (distance2(size.xz(), u.p0().xz()*2+1) < diameter*diameter)
-            v.clip(u).fill(t);
+    shape(v, Shape::cylinder(size.xz(), diameter*diameter), t);
 }
 
 
@@ -95,80 +177,224 @@ paint::tree(View v)
 }
 
 
+// lowest and highest of h over [p0, p1)
+static ivec2
+height_range(pgamecc::Image<int>& h, ivec2 p0, ivec2 p1)
+{
+    ivec2 r(h[p0], h[p0]);
+    for (int z = p0.y; z < p1.y; z++)
+        for (int x = p0.x; x < p1.x; x++) {
+            int v = h[ivec2(x, z)];
+            r = ivec2(min(r.x, v), max(r.y, v));
+        }
+    return r;
+}
+
+// Parts of a view that start out as one tile are built bottom-up, see
+// View::build, asking about blocks rather than filling each column.
+
 void
 paint::heightmap(View v, pgamecc::Image<int> h, Tile t)
 {
     v = v.base();
     assert(h.size() == v.model_box().size().xz());
-    for (auto u: v.model_box().boxes_y())
-        v.clip(u.p0() + Box({1, h[u.p0().xz()], 1})).fill(t);
+    v.parallel(split_depth, [&] (View part, Box b) {
+        part = part.clip(b);
+        bool built = part.build([&] (Box m) {
+            ivec2 r = height_range(h, m.p0().xz(), m.p1().xz());
+            if (m.y1() <= r.x)
+                return BuildBlock{ BuildBlock::fill, t };
+            if (m.y0() >= r.y)
+                return BuildBlock{ BuildBlock::background };
+            return BuildBlock{ BuildBlock::mixed };
+        });
+        if (built)
+            return;
+
+        EditBatch batch;
+        for (auto u: columns(b))
+            part.clip(u.p0() + Box({1, h[u.p0().xz()], 1})).fill(t, batch);
+        part.apply(batch);
+    });
 }
 
 
+// Shaped tile i above the top cube of a column with corner heights l, of
+// which m is the lowest.
+static Tile
+smooth_top(ivec4 l, int m, int i, Tile t)
+{
+    auto f = glm::greaterThan(l, glm::ivec4(m+i));
+    auto top = boct::empty();
+    for (int j = 0; j < 4; j++) {
+        top[ioct{j%2, 0, j/2}] |= !(glm::compAdd(ivec4(f)) == 1 && f[j^3]);
+        top[ioct{j%2, 1, j/2}] |= f[j];
+    }
+    return t.shape(top);
+}
+
 void
 paint::heightmap_smooth(View v, pgamecc::Image<int> h, Tile t)
 {
     v = v.base();
     assert(h.size() == v.model_box().size().xz() + 1);
 
-    for (auto u: v.model_box().boxes_y()) {
+    auto corners = [&] (ivec3 u) {
         ivec4 l;
         for (int i = 0; i < 4; i++)
-            l[i] = h[u.p0().xz() + ivec2(i%2, i/2)];
-        int m = glm::compMin(l);
-        v.clip(u.p0() + Box{ivec3(1, m, 1)}).fill(t);
-        for (int i = 0; i < 2; i++) {
-            auto f = glm::greaterThan(l, glm::ivec4(m+i));
-            auto top = boct::empty();
-            for (int j = 0; j < 4; j++) {
-                top[ioct{j%2, 0, j/2}] |= !(glm::compAdd(ivec4(f)) == 1 &&
-                                            f[j^3]);
-                top[ioct{j%2, 1, j/2}] |= f[j];
-            }
-            if (Tile top_tile = t.shape(top))
-                v.clip(u.p0() + ivec3(0, m+i, 0) + SBox{1}).fill(top_tile);
+            l[i] = h[u.xz() + ivec2(i%2, i/2)];
+        return l;
+    };
+
+    v.parallel(split_depth, [&] (View part, Box b) {
+        part = part.clip(b);
+        bool built = part.build([&] (Box m) {
+            ivec2 r = height_range(h, m.p0().xz(), m.p1().xz() + 1);
+            if (m.y1() <= r.x)
+                return BuildBlock{ BuildBlock::fill, t };
+            if (m.y0() >= r.y)
+                return BuildBlock{ BuildBlock::background };
+            if (m.size() != ivec3(1))
+                return BuildBlock{ BuildBlock::mixed };
+            ivec4 l = corners(m.p0());
+            int i = m.y0() - glm::compMin(l);
+            if (i < 2)
+                if (Tile top_tile = smooth_top(l, glm::compMin(l), i, t))
+                    return BuildBlock{ BuildBlock::fill, top_tile };
+            return BuildBlock{ BuildBlock::background };
+        });
+        if (built)
+            return;
+
+        EditBatch batch;
+        for (auto u: columns(b)) {
+            ivec4 l = corners(u.p0());
+            int m = glm::compMin(l);
+            part.clip(u.p0() + Box{ivec3(1, m, 1)}).fill(t, batch);
+            for (int i = 0; i < 2; i++)
+                if (Tile top_tile = smooth_top(l, m, i, t))
+                    part.clip(u.p0() + ivec3(0, m+i, 0) + SBox{1}).fill(
+                        top_tile, batch);
         }
-    }
+        part.apply(batch);
+    });
 }
 
 
-static auto
-rolling_hills_heightmap(ivec3 size)
+// TODO: random seed
+static void
+set_up_hills(PerlinNoise& noise)
 {
-    // TODO: random seed
-    PerlinNoise noise;
     noise.set_frequency(10);
+}
 
-    int h_max = size.y;
-    return make_image(size.xz(), [&] (auto p) {
-        return glm::clamp((int)((.5*noise(p)+.5) * h_max), 0, h_max);
+static int
+hill_height(PerlinNoise& noise, ivec2 p, int h_max)
+{
+    return glm::clamp((int)((.5*noise(p)+.5) * h_max), 0, h_max);
+}
+
+pgamecc::Image<int>
+paint::rolling_hills_heightmap_reference(ivec2 size, int h_max)
+{
+    PerlinNoise noise;
+    set_up_hills(noise);
+    return make_image(size, [&] (auto p) {
+        // the same sample type as rolling_hills_heightmap() passes
+        static_assert(std::is_same<std::decay_t<decltype(p)>, ivec2>::value,
+                      "make_image samples aren't ivec2");
+        return hill_height(noise, p, h_max);
+    });
+}
+
+// Rows go to worker threads in chunks, as the parts of View::parallel do.
+// Each worker has its own noise, which is set up the same way as the others,
+// so every sample is evaluated exactly as it would be on one thread.
+pgamecc::Image<int>
+paint::rolling_hills_heightmap(ivec2 size, int h_max, ivec2 origin)
+{
+    const int chunk = 16; // rows
+    vector<int> heights(size_t(size.x) * size.y);
+    atomic<int> next{0};
+    auto work = [&] {
+        PerlinNoise noise;
+        set_up_hills(noise);
+        for (int y0; (y0 = next.fetch_add(chunk)) < size.y;)
+            for (int y = y0; y < std::min(y0 + chunk, size.y); y++)
+                for (int x = 0; x < size.x; x++)
+                    heights[size_t(y) * size.x + x] =
+                        hill_height(noise, origin + ivec2(x, y), h_max);
+    };
+    size_t n = split_threads ? split_threads : thread::hardware_concurrency();
+    n = std::min(std::max(n, size_t(1)), size_t((size.y + chunk-1) / chunk));
+    vector<thread> workers;
+    for (size_t i = 1; i < n; i++)
+        workers.emplace_back(work);
+    work();
+    for (auto& w: workers)
+        w.join();
+
+    return make_image(size, [&] (ivec2 p) {
+        return heights[size_t(p.y) * size.x + p.x];
     });
 }
 
 void
 paint::rolling_hills(View v, Tile t)
 {
-    heightmap(v, rolling_hills_heightmap(v.model_box().size()), t);
+    ivec3 s = v.model_box().size();
+    heightmap(v, rolling_hills_heightmap(s.xz(), s.y), t);
 }
 
 void
 paint::rolling_hills_smooth(View v, Tile t)
 {
-    heightmap_smooth(v, rolling_hills_heightmap(v.model_box().size()+1), t);
+    ivec3 s = v.model_box().size() + 1;
+    heightmap_smooth(v, rolling_hills_heightmap(s.xz(), s.y), t);
+}
+
+void
+paint::rolling_hills_plane(View v, int h_max, Tile t)
+{
+    Box b = v.model_box();
+    v = v.clip(Box::ranged(ivec3(b.x0(), 0, b.z0()),
+                           ivec3(b.x1(), h_max, b.z1())));
+    b = v.model_box();
+    if (b.empty())
+        return;
+    assert(b.y0() == 0 && b.y1() == h_max);
+    heightmap_smooth(v, rolling_hills_heightmap(b.size().xz() + 1, h_max,
+                                                b.p0().xz()), t);
 }
 
 
 void
-paint::trees(View v)
+paint::trees(View v, uint32_t seed)
 {
     v = v.base();
+    // Trees are placed first, in order, so that where they go doesn't depend
+    // on how the painting is split, only on the seed. A tree across parts is
+    // copied into each of them, each keeping what is in its own part.
+    std::mt19937 random(seed);
+    vector<Box> placed;
     for (auto u: v.model_box().trim(ivec3(2, 0, 2), ivec3(2, 0, 2)).boxes_y())
-        if (entropy::dice(1000) == 0) {
+        if (random() % 1000 == 0) {
             int h = 0;
             v.clip(u).each_tile([&] (SBox s, Tile t) {
                 if (!t.shape())
                     h = max(h, s.y1());
             });
-            tree(v.clip(Box{ivec3(5, 11, 5)} + ivec3(u.x0()-2, h, u.z0()-2)));
+            placed.push_back(Box{ivec3(5, 11, 5)} +
+                             ivec3(u.x0()-2, h, u.z0()-2));
         }
+    // The trees are all the same, so one is painted into a grid of its own,
+    // null where it has nothing, and copied to each place, see View::copy.
+    Grid prefab(16);
+    tree(View(prefab).clip(Box{ivec3(5, 11, 5)}));
+    View stamp(prefab);
+    v.parallel(split_depth, [&] (View part, Box b) {
+        for (auto t: placed)
+            if (t.intersects(b))
+                part.clip(t).copy(stamp.translate(-t.p0()));
+    });
 }
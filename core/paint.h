@@ -2,18 +2,42 @@
 #define CORE_PAINT_H
 
 #include "grid.h"
+#include "shape.h"
+
+#include <cstdint>
 
 namespace paint {
 
+// Fill the cells whose centers are in the shape, given in model coordinates
+// of the view. Blocks that are inside or outside as a whole are filled or
+// left at once, so only cells along the surface are looked at one by one.
+void shape(View, const Shape&, Tile);
+
+// Fill the cells with any corner in the shape, shaped after those corners.
+void shape_smooth(View, const Shape&, Tile);
+
 void sphere(View, Tile);
 void sphere_smooth(View, Tile);
 void cylinder(View, Tile);
 void tree(View);
 void heightmap(View, pgamecc::Image<int>, Tile);
 void heightmap_smooth(View, pgamecc::Image<int>, Tile);
+// heights 0 to h_max, sampled from origin on, evaluated over split_threads
+// threads
+pgamecc::Image<int> rolling_hills_heightmap(
+    pgamecc::ivec2 size, int h_max,
+    pgamecc::ivec2 origin = pgamecc::ivec2(0));
+// Straightforward single-threaded version, kept as a reference for tests and
+// benchmarks.
+pgamecc::Image<int> rolling_hills_heightmap_reference(pgamecc::ivec2 size,
+                                                      int h_max);
 void rolling_hills(View, Tile);
 void rolling_hills_smooth(View, Tile);
-void trees(View);
+// Hills from the model's y = 0 up to h_max, sampled at the model's x and z
+// rather than from the corner of the view, so that views of neighbouring
+// pages of a World line up. The view has all of that height or none of it.
+void rolling_hills_plane(View, int h_max, Tile);
+void trees(View, uint32_t seed); // placed at random, the same for a seed
 
 }
 
@@ -6,6 +6,7 @@
 #include "effect.h"
 #include "grid.h"
 #include "mesh.h"
+#include "packed.h"
 #include "sea.h"
 
 #include <glm/ext.hpp>
@@ -98,8 +99,12 @@ struct OctantTileRenderer {
     const Convex<6> frustum;
     Octant octant;
 
-    ioct render(Grid::const_cursor cursor, bool all_inside = false) const {
-        // assumes cursor is not null
+    // a template so as not to depend on the kind of grid drawn
+    template<typename Cursor>
+    ioct render(Cursor cursor, bool all_inside = false) const {
+        // null, as in an overlay, has nothing of its own to draw
+        if (cursor.is_null() || cursor.is_branch() && !cursor.occupied())
+            return ioct{0};
         // TODO: limit depth for checks (don't bother with small boxes)
         bool cull = !all_inside;
         if (cull) {
@@ -115,6 +120,8 @@ struct OctantTileRenderer {
             return ioct{0}; // might not occlude, e.g. culled by the near plane
         else if (!cursor.is_tile()) {
             // branch
+            // children with nothing to draw neither draw nor occlude
+            int occupied = cursor.occupied();
             int occludes = 7;
             bool back_hidden = true;
             for (int i: { 7, 6, 5, 3, 4, 2, 1, 0 }) {
@@ -122,7 +129,8 @@ struct OctantTileRenderer {
                     break;
 
                 ioct j{i^octant.octant.i()};
-                ioct o = render(cursor[j], all_inside);
+                ioct o = occupied >> j.i() & 1 ? render(cursor[j], all_inside)
+                                               : ioct{0};
 
                 // occlusion derived from this box
                 //if (!o.x() && !(i & 1))
@@ -163,9 +171,10 @@ struct OctantTileRenderer {
 }
 
 void
-Renderer::render_tiles(const Projection& projection, const Grid& grid)
+Renderer::render_tiles(const Projection& projection,
+                       const PackedGrid& grid)
 {
-    size_t cubes_rendered = 0;
+    _stats = {};
     vector<glm::vec4> ts;
     vector<glm::vec3> color;
 
@@ -173,7 +182,8 @@ Renderer::render_tiles(const Projection& projection, const Grid& grid)
         WithProgram<0, 1> with(cube_prog);
         streams.cube.attribs_instanced(cube_prog, 0, 1);
         glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 8, streams.cube.size());
-        cubes_rendered += streams.cube.size();
+        _stats.cubes += streams.cube.size();
+        _stats.draws++;
     });
 
     auto shape_render = [&] (int i) {
@@ -185,6 +195,8 @@ Renderer::render_tiles(const Projection& projection, const Grid& grid)
         streams.shapes[i].attribs_instanced(tile_prog, 3, 4, 5);
         glDrawArraysInstanced(GL_TRIANGLES, 0, arrays.shape_pnb[i][0].size(),
                               streams.shapes[i].size());
+        _stats.shapes += streams.shapes[i].size();
+        _stats.draws++;
     };
 
     for (int i = 0; i < 3; i++)
@@ -332,7 +344,7 @@ Renderer::render_effects(const Projection& projection)
 
 void
 Renderer::render(ivec2 size, const Camera& camera,
-                 const Grid& grid, const Sea& sea)
+                 const PackedGrid& grid, const Sea& sea)
 {
     background = dvec4(0, 0, .05, 1);
 
@@ -15,7 +15,7 @@ namespace gl = pgamecc::gl;
 
 class Projection;
 class Camera;
-class Grid;
+class PackedGrid;
 class Sea;
 class Mesh;
 
@@ -35,6 +35,15 @@ struct SpriteStream {
 
 
 class Renderer {
+public:
+    // what the last frame drew
+    struct Stats {
+        size_t cubes; // instances
+        size_t shapes;
+        size_t draws; // of tiles
+    };
+
+private:
     gl::Program cube_prog, tile_prog, mesh_prog, thruster_prog, ball_prog,
                 bolt_prog, cube_effect_prog, post_prog;
     gl::UniformBuffer<char> common;
@@ -61,15 +70,18 @@ class Renderer {
     } fbo;
 
     dvec4 background;
+    Stats _stats{};
 
-    void render_tiles(const Projection&, const Grid&);
+    void render_tiles(const Projection&, const PackedGrid&);
     void render_sprites(const Projection&, SpriteStream&);
     void render_bolts(const Projection&, SpriteStream&);
     void render_effects(const Projection&);
 
 public:
     Renderer();
-    void render(ivec2 size, const Camera&, const Grid&, const Sea&);
+    void render(ivec2 size, const Camera&, const PackedGrid&, const Sea&);
+
+    Stats stats() const { return _stats; }
 };
 
 
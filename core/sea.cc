@@ -17,7 +17,6 @@ using std::exchange;
 using std::make_tuple;
 using std::move;
 using std::list;
-using std::prev;
 using std::set;
 using pgamecc::operator<<;
 
@@ -51,6 +50,7 @@ Sprite::bound() const
 Island::Island(Sea& sea, Box bound) :
     sea(sea),
     contact_joints(world),
+    region(bound),
     bound(bound),
     origin(bound.center())
 {
@@ -100,71 +100,87 @@ Island::create_voxel(SBox s, Tile t)
     }
 }
 
+//
+// Island::VoxelTable
+//
+
+auto
+Island::VoxelTable::lower_bound(Morton key) -> vector<Entry>::iterator
+{
+    return std::lower_bound(entries.begin(), entries.end(), key,
+                            [] (const Entry& e, Morton k) { return e.key < k; });
+}
+
+Island::Voxel*
+Island::VoxelTable::find(ivec3 p)
+{
+    Morton key{p};
+    auto it = lower_bound(key);
+    return it != entries.end() && it->key == key ? &it->voxel : nullptr;
+}
+
 void
-Island::sync(const Grid& grid)
+Island::VoxelTable::erase(vector<ivec3> origins)
 {
-    Box new_bound{ivec3()};
-    for (auto& sprite: sprites) {
-        auto b = sprite->bound();
-        if (new_bound.empty())
-            new_bound = b;
-        else
-            new_bound |= b;
+    vector<Morton> keys;
+    keys.reserve(origins.size());
+    for (auto p: origins)
+        keys.emplace_back(p);
+    std::sort(keys.begin(), keys.end());
+    auto k = keys.begin();
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+        [&] (const Entry& e) {
+            while (k != keys.end() && *k < e.key)
+                ++k;
+            return k != keys.end() && *k == e.key;
+        }), entries.end());
+}
+
 
-        // all keys from map before hint are guaranteed < key of tile
-        auto hint = voxels.begin();
+void
+Island::sync(Grid& grid)
+{
+    // Only what is near a sprite, rather than all of a hull around them
+    // that may be mostly empty space. Overlapping bounds are looked at once.
+    region.clear();
+    for (auto& sprite: sprites)
+        region |= sprite->bound();
+    bound = region.bound();
+    region.each([&] (Box b) { grid.generate(b); });
 
+    sync_tiles.clear();
+    region.each([&] (Box b) {
         grid.ctop().each_tile(b, [&] (SBox s, Tile t) {
-            assert(t); // not empty, assumed by collision code
-            int repeat = 0;
-        again:
-            assert(hint == voxels.begin() ||
-                   Grid::cursor::coord_less(prev(hint)->first, s.p0()));
-            if (hint == voxels.end())
-            insert:
-                hint = voxels.emplace_hint(hint, s.p0(),
-                    Voxel{create_voxel(s, t), s, t, true});
-            else if (hint->first == s.p0()) {
-                Voxel& v = hint->second;
-                // keep tile updated to avoid cursor lookup
-                if (v.box.size() != s.size() || v.tile != t) {
-                    v.geom = create_voxel(s, t);
-                    v.box = s;
-                    v.tile = t;
-                }
-                assert(v.box == s);
-                v.seen = true;
-            } else if (Grid::cursor::coord_less(s.p0(), hint->first))
-                // this is more expensive and less likely to be true than then
-                // == test above, so ordered here instead of as an alternative
-                // condition for the insert clause
-                goto insert;
-            else {
-                // short forward search before exhaustive search
-                if (repeat++ < 3)
-                    ++hint;
-                else
-                    hint = voxels.lower_bound(s.p0());
-                    // now one of the other conditions will be met
-                goto again;
-            }
-            ++hint;
+            sync_tiles.emplace_back(s, t);
         });
+    });
+    overlay = Grid(grid.size()); // null, nothing edited yet this step
+    contacts = tile_edits = 0;
+
+    // each box's tiles are in order, but a tile may reach into more than one
+    if (region.size() > 1) {
+        auto less = [] (auto& a, auto& b) {
+            return Grid::cursor::coord_less(a.first.p0(), b.first.p0());
+        };
+        auto same = [] (auto& a, auto& b) {
+            return a.first.p0() == b.first.p0();
+        };
+        std::sort(sync_tiles.begin(), sync_tiles.end(), less);
+        sync_tiles.erase(
+            std::unique(sync_tiles.begin(), sync_tiles.end(), same),
+            sync_tiles.end());
     }
-    bound = new_bound;
-
-    for (auto it = voxels.begin(); it != voxels.end();)
-        if (it->second.seen) {
-            it->second.seen = false;
-            ++it;
-        } else
-            it = voxels.erase(it);
+
+    voxels.merge(sync_tiles, [&] (SBox s, Tile t) {
+        return create_voxel(s, t);
+    });
 }
 
 
 void
-Island::tick(Grid& grid)
+Island::tick(const Grid& grid)
 {
+    tick_grid = &grid;
     for (auto& sprite: sprites)
         sprite->before_tick();
 
@@ -174,11 +190,13 @@ Island::tick(Grid& grid)
     // work, removing won't.
 
     set<Sprite*> destroyed_sprites;
-    list<ivec3> destroyed_voxels;
+    vector<ivec3> destroyed_voxels;
+    EditBatch edits; // applied to the grid after all collisions
     // NOTE: smaller space last, otherwise ODE uses a swapped callback
     ode::collide(voxel_space, sprite_space,
                  [&] (const auto& voxel_geom, const auto& sprite_geom) {
         ode::contacts(sprite_geom, voxel_geom, [&] (ode::Contact contact) {
+            contacts++;
             Sprite& sprite = Sprite::find(sprite_geom.body());
 
             if (destroyed_sprites.count(&sprite))
@@ -204,7 +222,14 @@ Island::tick(Grid& grid)
                 glm::clamp(ivec3(glm::floor(contact.position())) + origin,
                            voxel.box.p0(), voxel.box.p1()-1);
             assert([&]{
-                auto c = grid.ctop().find_smallest(b);
+                // the voxel follows edits of this tick, which aren't in the
+                // overlay yet
+                if (auto pending = edits.last(voxel.box))
+                    return *pending == voxel.tile;
+                auto find = [&] (const Grid& g) {
+                    return g.ctop().find_smallest(b);
+                };
+                auto c = find(overlay).is_null() ? find(grid) : find(overlay);
                 return c.is_tile() && c.tile() == voxel.tile;
             }());
 
@@ -223,15 +248,16 @@ Island::tick(Grid& grid)
             }
 
             if (last_tile != voxel.tile) { // changed by collide()
-                grid.top().fill(b, voxel.tile);
+                edits.fill(b, voxel.tile);
                 new BoxEffect(b);
                 if (!voxel.tile)
                     destroyed_voxels.push_back(b.p0());
             }
         });
     });
-    for (auto i: exchange(destroyed_voxels, {}))
-        voxels.erase(i);
+    tile_edits += edits.size();
+    overlay.apply(edits);
+    voxels.erase(exchange(destroyed_voxels, {}));
     for (auto i: exchange(destroyed_sprites, {}))
         // TODO: optimize
         sprites.remove_if([&] (auto& p) { return p.get() == i; });
@@ -241,6 +267,7 @@ Island::tick(Grid& grid)
     {
         ode::contacts(sprite1_geom, sprite2_geom,
                       [&] (ode::Contact contact) {
+            contacts++;
             Sprite& sprite1 = Sprite::find(sprite1_geom.body());
             Sprite& sprite2 = Sprite::find(sprite2_geom.body());
             assert(&sprite1 != &sprite2);
@@ -297,7 +324,7 @@ Island::show() const
 
     cout << voxels.size() << " voxels\n";
     for (auto& v: voxels)
-        cout << "    " << v.second.box << ": " << v.second.geom << '\n';
+        cout << "    " << v.voxel.box << ": " << v.voxel.geom << '\n';
 }
 #endif
 
@@ -336,6 +363,23 @@ Sea::step(Grid& grid)
     for (int i = 0; i < 10; i++)
         for (auto& island: islands)
             island.tick(grid);
+    // where islands edited the same tile, the last one merged wins
+    for (auto& island: islands)
+        grid.merge(island.overlay);
+}
+
+
+Sea::Stats
+Sea::stats() const
+{
+    Stats r{islands.size(), 0, 0, 0, 0};
+    for (auto& island: islands) {
+        r.sprites += island.sprites.size();
+        r.voxels += island.voxels.size();
+        r.contacts += island.contacts;
+        r.tile_edits += island.tile_edits;
+    }
+    return r;
 }
 
 
@@ -6,20 +6,20 @@
 #include "ode.h"
 
 #include <list>
-#include <map>
 #include <memory>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 using std::enable_if_t;
 using std::is_base_of;
 using std::is_standard_layout;
 using std::is_trivially_destructible;
 using std::list;
-using std::map;
 using std::move;
 using std::pair;
 using std::unique_ptr;
+using std::vector;
 using pgamecc::dvec3;
 
 class SpriteStream;
@@ -166,12 +166,43 @@ struct Island { // TODO: class
         // more data to simplify collision handling.
         SBox box;
         Tile tile; // kept current, no need for cursor lookup
-        bool seen;
     };
     static_assert(is_standard_layout<Voxel>::value, ""); // cast &geom to Voxel
-    map<ivec3, Voxel, Grid::cursor::CoordLess> voxels;
 
-    Box bound;
+    // Voxels in a flat array sorted by Morton key of the box origin, which is
+    // the order in which tiles come out of the grid, so it can be brought
+    // up-to-date in one merge pass. Moving a voxel is fine since ode::Geom
+    // updates the pointer ODE keeps to it.
+    class VoxelTable {
+        struct Entry {
+            Morton key;
+            Voxel voxel;
+        };
+        vector<Entry> entries, scratch; // scratch keeps capacity for merge
+
+        vector<Entry>::iterator lower_bound(Morton);
+
+    public:
+        size_t size() const { return entries.size(); }
+        auto begin() const { return entries.begin(); }
+        auto end() const { return entries.end(); }
+
+        Voxel* find(ivec3);
+        Voxel& at(ivec3 p) { auto v = find(p); assert(v); return *v; }
+
+        // Replace contents with voxels for tiles, which must be in traversal
+        // order. Voxels that are already up-to-date are kept, others are
+        // created with create(SBox, Tile).
+        template<typename Create>
+        void merge(const vector<pair<SBox, Tile>>& tiles, Create create);
+
+        // remove voxels at any of these origins
+        void erase(vector<ivec3>);
+    } voxels;
+    vector<pair<SBox, Tile>> sync_tiles; // keeps capacity between syncs
+
+    BoxSet region; // covered by sprite bounds, as of sync
+    Box bound; // of region
     ivec3 origin; // grid-global position = world position + origin
                   // Integer to maintain precision across entire grid and to
                   // simplify casting world (local) position to integer tile
@@ -180,6 +211,14 @@ struct Island { // TODO: class
     int next_sync;
     double tick_size = 1 / 60. / 10;
 
+    // Edits made during the current step, null wherever the grid is as it
+    // was when the step began. The grid isn't edited until Sea::step merges
+    // the overlays of all islands at its end, so islands tick independently.
+    Grid overlay;
+    const Grid* tick_grid = nullptr; // during tick(), below overlay
+
+    size_t contacts = 0, tile_edits = 0; // since sync, see Sea::stats
+
     ode::Geom create_voxel(SBox, Tile);
 
 public:
@@ -197,10 +236,12 @@ public:
         return sprite;
     }
 
-    void sync(const Grid&);
+    // generates the region first if the grid is lazily generated
+    void sync(Grid&);
 
-    // Simulation moves in small ticks, perhaps 600 per second.
-    void tick(Grid&); // TODO: this should edit grid overlay
+    // Simulation moves in small ticks, perhaps 600 per second. Edits go to
+    // overlay.
+    void tick(const Grid&);
 
     // And then update voxels according to grid data.
 
@@ -210,10 +251,64 @@ public:
 
     void render(SpriteStream&) const;
 
+    // for sprites during tick(), through overlay onto the grid
+    void raycast(RayPacket& packet) const {
+        overlay.raycast(packet, *tick_grid);
+    }
+
+    // What raycast() looks at, as of now, so that a sprite that keeps ray
+    // hits between ticks can tell when edits may have changed them.
+    struct Generations {
+        uint64_t grid, overlay;
+    };
+    Generations generations() const {
+        return { tick_grid->changes().generation(),
+                 overlay.changes().generation() };
+    }
+    bool changed(Generations since, Box bound) const {
+        return tick_grid->changes().changed(since.grid, bound) ||
+               overlay.changes().changed(since.overlay, bound);
+    }
+
     friend class Body;
 };
 
 
+template<typename Create>
+void
+Island::VoxelTable::merge(const vector<pair<SBox, Tile>>& tiles, Create create)
+{
+    scratch.clear();
+    scratch.reserve(tiles.size());
+    auto old = entries.begin();
+    for (auto& st: tiles) {
+        SBox s = st.first;
+        Tile t = st.second;
+        assert(t); // not empty, assumed by collision code
+        Morton key{s.p0()};
+        assert(scratch.empty() || scratch.back().key < key);
+
+        // skipped voxels are no longer needed
+        while (old != entries.end() && old->key < key)
+            ++old;
+
+        if (old != entries.end() && old->key == key) {
+            Voxel& v = old->voxel;
+            // keep tile updated to avoid cursor lookup
+            if (v.box.size() != s.size() || v.tile != t) {
+                v.geom = create(s, t);
+                v.box = s;
+                v.tile = t;
+            }
+            scratch.push_back(move(*old++));
+        } else
+            scratch.push_back({ key, Voxel{create(s, t), s, t} });
+    }
+    entries.swap(scratch);
+    scratch.clear(); // destroys voxels that weren't carried over
+}
+
+
 // Collection of all islands.
 
 class Sea {
@@ -238,7 +333,8 @@ public:
     // - sparsely populated islands are split
     // - new islands are created for new craft
     // - island simulations tick (10 ticks per step)
-    // - grid edits are incorporated into the global grid
+    // - grid edits are incorporated into the global grid, merging the
+    //   overlay of each island in turn
     void step(Grid&);
 
 #ifndef NDEBUG
@@ -247,6 +343,14 @@ public:
 
     void render(SpriteStream&) const;
 
+    // what the last step simulated
+    struct Stats {
+        size_t islands, sprites, voxels;
+        size_t contacts; // voxel and sprite contacts over all ticks
+        size_t tile_edits;
+    };
+    Stats stats() const;
+
     list<const Island*> all() const; // TODO: better access mechanism
                                      // TODO: only in frustum
 
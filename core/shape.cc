@@ -0,0 +1,114 @@
+#include "shape.h"
+
+#include <cstdint>
+
+
+// Distances are squared in 64 bits: half units of a large grid squared and
+// added over three axes don't fit in an int.
+
+static int64_t
+length2(ivec3 v)
+{
+    return int64_t(v.x) * v.x + int64_t(v.y) * v.y + int64_t(v.z) * v.z;
+}
+
+// the closed box [lo, hi] against points nearer than sqrt(radius2) to
+// center, by the box's nearest and farthest points
+static ConvexTest
+distance_test(ivec3 center, int64_t radius2, ivec3 lo, ivec3 hi)
+{
+    ivec3 nearest = glm::clamp(center, lo, hi) - center;
+    ivec3 farthest = glm::max(glm::abs(lo - center), glm::abs(hi - center));
+    if (length2(farthest) < radius2)
+        return ConvexTest::inside;
+    if (length2(nearest) >= radius2)
+        return ConvexTest::outside;
+    return ConvexTest::partial;
+}
+
+
+Shape
+Shape::box(Box b)
+{
+    ivec3 p0 = b.p0() * 2, p1 = b.p1() * 2;
+    return {
+        [=] (ivec3 p) {
+            return glm::all(glm::lessThanEqual(p0, p)) &&
+                   glm::all(glm::lessThanEqual(p, p1));
+        },
+        [=] (ivec3 lo, ivec3 hi) {
+            if (glm::any(glm::lessThan(hi, p0)) ||
+                    glm::any(glm::lessThan(p1, lo)))
+                return ConvexTest::outside;
+            if (glm::all(glm::lessThanEqual(p0, lo)) &&
+                    glm::all(glm::lessThanEqual(hi, p1)))
+                return ConvexTest::inside;
+            return ConvexTest::partial;
+        },
+    };
+}
+
+Shape
+Shape::sphere(ivec3 center, int radius2)
+{
+    return {
+        [=] (ivec3 p) { return length2(p - center) < radius2; },
+        [=] (ivec3 lo, ivec3 hi) {
+            return distance_test(center, radius2, lo, hi);
+        },
+    };
+}
+
+Shape
+Shape::cylinder(ivec2 center, int radius2)
+{
+    // y is always at the center
+    auto flat = [=] (ivec3 p) { return ivec3(p.x, 0, p.z); };
+    ivec3 c(center.x, 0, center.y);
+    return {
+        [=] (ivec3 p) { return length2(flat(p) - c) < radius2; },
+        [=] (ivec3 lo, ivec3 hi) {
+            return distance_test(c, radius2, flat(lo), flat(hi));
+        },
+    };
+}
+
+
+Shape
+Shape::operator|(const Shape& r) const
+{
+    Shape l = *this;
+    return {
+        [=] (ivec3 p) { return l.contains(p) || r.contains(p); },
+        [=] (ivec3 lo, ivec3 hi) {
+            ConvexTest a = l.test(lo, hi);
+            return a == ConvexTest::inside ? a : a | r.test(lo, hi);
+        },
+    };
+}
+
+Shape
+Shape::operator&(const Shape& r) const
+{
+    Shape l = *this;
+    return {
+        [=] (ivec3 p) { return l.contains(p) && r.contains(p); },
+        [=] (ivec3 lo, ivec3 hi) {
+            ConvexTest a = l.test(lo, hi);
+            return a == ConvexTest::outside ? a : a & r.test(lo, hi);
+        },
+    };
+}
+
+Shape
+Shape::operator-(const Shape& r) const
+{
+    Shape l = *this;
+    return {
+        [=] (ivec3 p) { return l.contains(p) && !r.contains(p); },
+        [=] (ivec3 lo, ivec3 hi) {
+            ConvexTest a = l.test(lo, hi);
+            return a == ConvexTest::outside ? a : a & ~r.test(lo, hi);
+        },
+    };
+}
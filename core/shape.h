@@ -0,0 +1,46 @@
+#ifndef CORE_SHAPE_H
+#define CORE_SHAPE_H
+
+#include "box.h"
+#include "octant.h"
+
+#include <functional>
+
+#include <pgamecc.h>
+
+using std::function;
+using pgamecc::ivec2;
+
+
+// A solid in model space, to be painted with paint::shape. Coordinates are
+// in half units, so that both centers and corners of unit cells are integer
+// points: cell u has its center at u*2+1 and its corners at (u+c)*2.
+// contains(p) tells whether point p is inside. test(lo, hi) tells whether the
+// closed box from lo to hi is all inside, all outside or partly inside;
+// partial may also be said of a box that is either, which only means it is
+// looked at more closely, but inside or outside must be right.
+
+// Shapes combine as sets with |, & and -, and the tests combine the same way,
+// so a block that is outside of one side of a difference is never looked at
+// in the other.
+
+struct Shape {
+    function<bool(ivec3)> contains;
+    function<ConvexTest(ivec3 lo, ivec3 hi)> test;
+
+    // points in model box b, including its faces
+    static Shape box(Box b);
+
+    // points nearer than sqrt(radius2) to center
+    static Shape sphere(ivec3 center, int radius2);
+
+    // the same around a line parallel to y through center
+    static Shape cylinder(ivec2 center, int radius2);
+
+    Shape operator|(const Shape&) const;
+    Shape operator&(const Shape&) const;
+    Shape operator-(const Shape&) const;
+};
+
+
+#endif
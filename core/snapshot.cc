@@ -0,0 +1,116 @@
+#include "snapshot.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+const char magic[8] = { 'T', 'S', 'G', 'R', 'I', 'D', '\r', '\n' };
+
+}
+
+using std::vector;
+
+
+GridSnapshot::GridSnapshot(const string& path, uint64_t key)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(Header)) {
+        map_size = st.st_size;
+        map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            map = nullptr;
+    }
+    close(fd);
+    if (!map)
+        return;
+
+    auto& h = *static_cast<const Header*>(map);
+    if (memcmp(h.magic, magic, sizeof magic) || h.version != version ||
+            h.key != key || h.size <= 0 || h.size & (h.size - 1) ||
+            !h.words ||
+            h.words != (map_size - sizeof(Header)) / sizeof(PackedNode))
+        return;
+    nodes = reinterpret_cast<const PackedNode*>(&h + 1);
+    _size = h.size;
+    if (!check())
+        nodes = nullptr;
+}
+
+GridSnapshot::~GridSnapshot()
+{
+    if (map)
+        munmap(map, map_size);
+}
+
+// Every branch must point to a whole block inside the file, further on so that
+// there are no cycles, and be above size 1 wherever it is reached from, since
+// a shared block may be reached at more than one size. Because blocks come
+// after whatever points to them, the smallest size each node is reached at is
+// known by the time the pass gets to it, so the pass is linear and touches
+// each page once.
+bool
+GridSnapshot::check() const
+{
+    auto& h = *static_cast<const Header*>(map);
+    size_t words = h.words;
+    vector<int> reached(words, 0); // smallest size, 0 if not reached
+    reached[0] = _size;
+    for (size_t i = 0; i < words; i++)
+        if (nodes[i].is_branch()) {
+            size_t block = &nodes[i].branch()[ioct{0}] - nodes;
+            if (block <= i || block + 8 > words)
+                return false;
+            if (!reached[i])
+                continue;
+            if (reached[i] == 1)
+                return false;
+            for (size_t j = block; j < block + 8; j++)
+                if (!reached[j] || reached[j] > reached[i] / 2)
+                    reached[j] = reached[i] / 2;
+        }
+    return true;
+}
+
+bool
+GridSnapshot::save(const string& path, const PackedGrid& packed, uint64_t key)
+{
+    Header h;
+    memcpy(h.magic, magic, sizeof magic);
+    h.version = version;
+    h.size = packed.size();
+    h.key = key;
+    h.words = packed.words();
+
+    string temp = path + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(&h, sizeof h, 1, f) == 1 &&
+              fwrite(packed.data(), sizeof(PackedNode), h.words, f) == h.words;
+    ok &= fclose(f) == 0;
+    if (ok && rename(temp.c_str(), path.c_str()) == 0)
+        return true;
+    remove(temp.c_str());
+    return false;
+}
+
+uint64_t
+GridSnapshot::key(const string& parameters)
+{
+    uint64_t k = 0xcbf29ce484222325;
+    for (unsigned char c: parameters)
+        k = (k ^ c) * 0x100000001b3;
+    return k;
+}
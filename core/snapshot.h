@@ -0,0 +1,68 @@
+#ifndef CORE_SNAPSHOT_H
+#define CORE_SNAPSHOT_H
+
+#include "packed.h"
+
+#include <cstdint>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+using std::string;
+using boost::noncopyable;
+
+
+// A packed grid saved to a file. The file is a header followed by the words of
+// a PackedGrid as they are in memory, so opening a snapshot maps the file and
+// checks the size and the offsets, and that no branch is below size 1, and it
+// can be traversed in place without reading the whole file. The key is chosen by whoever saves the snapshot to identify what
+// it was generated from, typically with key() applied to the seed and
+// parameters, and a snapshot with a different key fails to open.
+
+// Words are stored in native byte order; a snapshot is a cache, not an
+// interchange format.
+
+class GridSnapshot : noncopyable {
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        int32_t size;
+        uint64_t key;
+        uint64_t words;
+    };
+    static_assert(sizeof(Header) == 32, "");
+
+    void* map = nullptr;
+    size_t map_size = 0;
+    const PackedNode* nodes = nullptr;
+    int _size = 0;
+
+    bool check() const;
+
+public:
+    enum { version = 1 };
+
+    GridSnapshot() {} // not open
+    GridSnapshot(const string& path, uint64_t key);
+    ~GridSnapshot();
+
+    // false if the file is missing, has another key or version, or is corrupt
+    explicit operator bool() const { return nodes; }
+
+    int size() const { return _size; }
+    PackedGrid::const_cursor top() const { return { nodes[0], SBox{_size} }; }
+    PackedGrid::const_cursor ctop() const { return top(); }
+
+    // Expand into an ordinary grid for editing.
+    Grid unpack() const { return Grid(_size, top().unpack()); }
+
+    // Write to a temporary file and rename it over path, so a snapshot being
+    // read is never seen half-written. Returns false on failure.
+    static bool save(const string& path, const PackedGrid&, uint64_t key);
+
+    // FNV-1a hash of a description of what was generated
+    static uint64_t key(const string& parameters);
+};
+
+
+#endif
@@ -28,6 +28,8 @@ struct ShapeLookup {
     enum { shapes = 29 };
     int shape_to_mesh[shapes];
     dquat shape_to_quat[shapes];
+    int shape_to_corners[shapes];
+    dvec4 shape_to_plane[shapes];
 
     ShapeLookup() {
         for (auto& c: corners_to_shape)
@@ -38,6 +40,8 @@ struct ShapeLookup {
             corners_to_shape[(r * model).i()] = s;
             shape_to_mesh[s] = mesh;
             shape_to_quat[s] = r.quat_cast();
+            shape_to_corners[s] = (r * model).i();
+            shape_to_plane[s] = plane(r * model);
             s++;
         };
 
@@ -54,6 +58,36 @@ struct ShapeLookup {
 
         assert(s == shapes);
     }
+
+    // Every shape is the cube cut by one plane. For corner1 it passes through
+    // the neighbours of the one corner with all its neighbours set, and for the
+    // others through the neighbours of a missing corner, ignoring the axis
+    // along which missing corners differ for ramps.
+    static dvec4 plane(boct corners) {
+        int set = corners.i();
+        if (set == 0xff)
+            return dvec4(0, 0, 0, 1);
+        bool inside = __builtin_popcount(set) == 4;
+        int c = 0, ignore = 0;
+        for (int i = 0; i < 8; i++) {
+            if (inside ? (set >> i & 1) && (set >> (i^1) & 1) &&
+                         (set >> (i^2) & 1) && (set >> (i^4) & 1)
+                       : !(set >> i & 1))
+                c = i;
+            for (int a = 0; a < 3; a++)
+                if (!inside && !(set >> i & 1) && !(set >> (i ^ 1 << a) & 1))
+                    ignore |= 1 << a;
+        }
+        // distance from corner c along an axis is c_a + (c_a ? -1 : 1) * p_a
+        dvec4 r(0, 0, 0, -1);
+        for (int a = 0; a < 3; a++)
+            if (!(ignore >> a & 1)) {
+                int c_a = c >> a & 1;
+                r[a] = c_a ? -1 : 1;
+                r.w += c_a;
+            }
+        return inside ? -r : r;
+    }
 } shape_lookup;
 }
 
@@ -80,6 +114,22 @@ Tile::shape_loc() const
     return dloc{dvec3{.5}, q} * dloc{dvec3(-.5), {}};
 }
 
+boct
+Tile::shape_corners() const
+{
+    int s = shape();
+    assert(0 <= s && s < shape_lookup.shapes);
+    return boct{shape_lookup.shape_to_corners[s]};
+}
+
+dvec4
+Tile::shape_plane() const
+{
+    int s = shape();
+    assert(0 <= s && s < shape_lookup.shapes);
+    return shape_lookup.shape_to_plane[s];
+}
+
 Tile
 Tile::shape(boct corners) const
 {
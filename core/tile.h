@@ -11,6 +11,7 @@
 #include <glm/glm.hpp>
 
 using pgamecc::dquat;
+using pgamecc::dvec4;
 using pgamecc::dloc;
 using pgamecc::boct;
 
@@ -27,6 +28,7 @@ using pgamecc::boct;
 
 class Tile {
     friend class Node;
+    friend class PackedNode;
     typedef uintptr_t data_type; // later assumed unsigned for bit shifts
     data_type data;
 
@@ -93,6 +95,7 @@ public:
         assert(0 <= v && v < (1 << hp_size) - 1);
         return set_bits(hp_bits, hp_size, v);
     }
+    int hp() const { return bits(hp_bits, hp_size); }
     Tile invulnerable() {
         return set_bits(hp_bits, hp_size, (1 << hp_size) - 1);
     }
@@ -126,6 +129,9 @@ public:
     short shape_mesh() const;
     dquat shape_quat() const;
     dloc shape_loc() const; // assumes size 1
+    boct shape_corners() const; // solid is the convex hull of these
+    // solid where dot(plane, (p, 1)) >= 0 for p inside the unit cube
+    dvec4 shape_plane() const;
     Tile shape(boct corners) const;
 
     bool operator==(Tile r) const { return data == r.data; }
@@ -58,6 +58,7 @@ Window::Window()
     assert(!Level::catalogue::empty());
     level.reset(Level::catalogue::first());
     level->generate();
+    level->publish();
 
     fps_overlay = create_layer<FPSOverlay>(*this);
     create_layer<ui::WindowControlLayer>(*this);
@@ -78,8 +79,12 @@ Window::background_input_key(bool press, int key, int mods)
           alt = mods & mod_alt,
         shift = mods & mod_shift;
 
+    // F2 toggles a log of what was simulated and drawn, and Ctrl-G prints
+    // what the grid holds, in debug builds
     if (press && key == '`')
         fps_overlay->active ^= 1;
+    else if (press && ctrl && key == 'G')
+        show_grid_stats = true;
     else if (press && key >= '0' && key <= '9')
         debug::number = key - '0';
     else if (press && key >= key_f1 && key <= key_f12)
@@ -94,6 +99,19 @@ Window::background_step()
 {
     level->step();
     BoxEffect::step_all();
+
+    // about once a second
+    if (debug::toggle[1] && ++steps % 60 == 0) {
+        auto s = level->sea.stats();
+        cout << "sea: " << s.islands << " islands, " << s.sprites
+             << " sprites, " << s.voxels << " voxels, " << s.contacts
+             << " contacts, " << s.tile_edits << " tile edits\n";
+    }
+#ifndef NDEBUG
+    // on this thread, since the step edits the grid
+    if (show_grid_stats.exchange(false))
+        level->grid.stats().show();
+#endif
 }
 
 
@@ -103,5 +121,13 @@ void Window::background_render_done() { renderer.reset(); }
 void
 Window::background_render()
 {
-    renderer->render(size(), level->camera, level->grid, level->sea);
+    // the step may be editing the grid meanwhile
+    renderer->render(size(), level->camera, *level->published_grid(),
+                     level->sea);
+
+    if (debug::toggle[1] && ++frames % 60 == 0) {
+        auto s = renderer->stats();
+        cout << "render: " << s.cubes << " cubes, " << s.shapes
+             << " shapes, " << s.draws << " draws\n";
+    }
 }
@@ -4,6 +4,7 @@
 #include <pgamecc.h>
 #include <pgamecc/ui.h>
 
+#include <atomic>
 #include <memory>
 
 using std::unique_ptr;
@@ -17,6 +18,10 @@ class Window : public pgamecc::ui::WindowBase {
     unique_ptr<Level> level;
     pgamecc::ui::Layer* fps_overlay;
 
+    // debug statistics, see background_input_key()
+    std::atomic<bool> show_grid_stats{false};
+    int steps = 0, frames = 0;
+
 public:
     Window();
     ~Window();
@@ -0,0 +1,255 @@
+#include "world.h"
+
+#include "packed.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+using std::ostringstream;
+using std::pair;
+using std::to_string;
+
+
+// ivec3 has no ordering of its own
+struct PageLess {
+    bool operator()(ivec3 a, ivec3 b) const {
+        return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+    }
+};
+
+
+World::World(int page_size, Generator generator, string cache_dir,
+             string cache_key) :
+    _page_size(page_size),
+    shift(0),
+    generator(std::move(generator)),
+    cache_dir(std::move(cache_dir)),
+    cache_key(std::move(cache_key))
+{
+    assert(page_size > 0 && (page_size & (page_size - 1)) == 0);
+    while (1 << shift < page_size)
+        shift++;
+}
+
+World::~World()
+{
+    for (auto& p: pages)
+        unload(p.first, p.second);
+}
+
+
+string
+World::page_path(ivec3 p) const
+{
+    ostringstream s;
+    s << cache_dir << "/page." << p.x << '.' << p.y << '.' << p.z << ".grid";
+    return s.str();
+}
+
+uint64_t
+World::page_key() const
+{
+    return GridSnapshot::key("world page " + to_string(_page_size) + " " +
+                             cache_key);
+}
+
+
+World::Page&
+World::page(ivec3 p)
+{
+    auto it = pages.find(p);
+    if (it != pages.end())
+        return it->second;
+
+    Page& page = pages[p];
+    if (!cache_dir.empty()) {
+        GridSnapshot snapshot(page_path(p), page_key());
+        if (snapshot && snapshot.size() == _page_size) {
+            page.grid = snapshot.unpack();
+            page.saved = page.grid.changes().generation();
+            return page;
+        }
+    }
+    page.grid = Grid(_page_size, Tile::empty());
+    // generated contents count as changes, so they are cached on unload
+    page.saved = page.grid.changes().generation();
+    if (generator)
+        generator(View(page.grid).translate(-p * _page_size));
+    return page;
+}
+
+void
+World::unload(ivec3 p, Page& page)
+{
+    if (!cache_dir.empty() && page.grid.changes().generation() != page.saved)
+        // failure only means the page is generated again next time
+        GridSnapshot::save(page_path(p), PackedGrid(page.grid), page_key());
+}
+
+
+void
+World::load(Box b)
+{
+    if (!b.empty())
+        for (auto p: pages_of(b).coords())
+            page(p);
+}
+
+void
+World::focus(const vector<Box>& areas,
+             const function<void(ivec3, Grid&)>& leaving)
+{
+    auto kept = [&] (ivec3 p) {
+        for (auto b: areas)
+            if (b.intersects(page_box(p)))
+                return true;
+        return false;
+    };
+    for (auto it = pages.begin(); it != pages.end();)
+        if (kept(it->first))
+            ++it;
+        else {
+            if (leaving)
+                leaving(it->first, it->second.grid);
+            unload(it->first, it->second);
+            it = pages.erase(it);
+        }
+}
+
+
+void
+World::fill(Box b, Tile t)
+{
+    if (b.empty())
+        return;
+    for (auto p: pages_of(b).coords())
+        page(p).grid.top().fill(b - p * _page_size, t);
+}
+
+void
+World::apply(const EditBatch& batch)
+{
+    // split into one batch per page, keeping the order of edits
+    std::map<ivec3, EditBatch, PageLess> split;
+    for (auto& e: batch.edits)
+        for (auto p: pages_of(e.b).coords())
+            split[p].fill((e.b & page_box(p)) - p * _page_size, e.t);
+    for (auto& p: split)
+        page(p.first).grid.apply(p.second);
+}
+
+
+vector<pair<ivec3, const Grid*>>
+World::pages_in(Box b) const
+{
+    vector<pair<ivec3, const Grid*>> r;
+    each_page(b, [&] (ivec3 p, const Grid& grid, Box) {
+        r.emplace_back(p * _page_size, &grid);
+    });
+    return r;
+}
+
+
+optional<RayHit>
+World::raycast(dvec3 origin, dvec3 direction, double length) const
+{
+    // Pages are cast in the order the ray enters them, which is front to back
+    // since they don't overlap, so the first hit is the nearest.
+    dvec3 end = origin + direction * length;
+    Box span = Box::ranged(ivec3(glm::floor(glm::min(origin, end))),
+                           ivec3(glm::floor(glm::max(origin, end))) + 1);
+    vector<pair<double, ivec3>> order;
+    each_page(span, [&] (ivec3 p, const Grid&, Box) {
+        Box b = page_box(p);
+        double t0 = 0, t1 = length;
+        for (int a = 0; a < 3; a++) {
+            if (direction[a] == 0) {
+                if (origin[a] < b.p0()[a] || origin[a] > b.p1()[a])
+                    return;
+                continue;
+            }
+            double ta = (b.p0()[a] - origin[a]) / direction[a],
+                   tb = (b.p1()[a] - origin[a]) / direction[a];
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        if (t0 <= t1)
+            order.push_back({ t0, p });
+    });
+    std::sort(order.begin(), order.end(),
+              [] (auto& a, auto& b) { return a.first < b.first; });
+
+    for (auto& o: order) {
+        ivec3 offset = o.second * _page_size;
+        auto hit = pages.at(o.second).grid.raycast(
+            origin - dvec3(offset), direction, length);
+        if (hit) {
+            hit->p += dvec3(offset);
+            hit->box = hit->box + offset;
+            return hit;
+        }
+    }
+    return {};
+}
+
+
+
+//
+// WorldCursor
+//
+
+const Grid*
+WorldCursor::page(ivec3& origin) const
+{
+    auto it = world.pages.find(world.page_of(s.p0()));
+    if (it == world.pages.end())
+        return nullptr;
+    origin = s.p0();
+    return &it->second.grid;
+}
+
+bool
+WorldCursor::is_null() const
+{
+    // whichever is fewer, the pages here or the pages loaded
+    Box here = world.pages_of(s);
+    ivec3 n = here.size();
+    if (size_t(n.x) * size_t(n.y) * size_t(n.z) <= world.pages.size()) {
+        for (auto p: here.coords())
+            if (world.pages.count(p))
+                return false;
+        return true;
+    }
+    for (auto& p: world.pages)
+        if (here.contains(p.first + Box{ivec3(1)}))
+            return false;
+    return true;
+}
+
+
+
+//
+// View
+//
+
+void
+View::world_fill(Tile t) const
+{
+    world->fill(grid_box(), t);
+}
+
+void
+View::world_apply(const EditBatch& batch) const
+{
+    world->apply(batch);
+}
+
+vector<pair<ivec3, const Grid*>>
+View::world_pages() const
+{
+    return world->pages_in(grid_box());
+}
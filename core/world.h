@@ -0,0 +1,214 @@
+#ifndef CORE_WORLD_H
+#define CORE_WORLD_H
+
+#include "box.h"
+#include "grid.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <glm/glm.hpp>
+
+using std::function;
+using std::string;
+using std::unordered_map;
+using std::vector;
+using boost::noncopyable;
+
+
+// A world is space without the bounds of a single grid, divided into cubic
+// pages, each its own Grid. Coordinates are world coordinates, which may be
+// negative; page p covers page_size * p + SBox{page_size}. Pages are loaded on
+// demand, from a snapshot in the cache directory if one was saved when the
+// page was last unloaded and otherwise by calling the generator with a view of
+// the page. Space in a page that isn't loaded is empty as far as queries are
+// concerned, and null to a WorldCursor.
+
+// A Level can be set in a world, see Level::use_world, in which case its grid
+// holds the pages around the camera and the islands.
+
+class World : noncopyable {
+public:
+    // Paints a page, which starts out empty; the view's model box is the page
+    // box in world coordinates.
+    using Generator = function<void(View)>;
+
+private:
+    struct Page {
+        Grid grid;
+        uint64_t saved; // journal generation when last loaded or saved
+    };
+
+    struct PageHash {
+        size_t operator()(ivec3 p) const {
+            return (size_t(uint32_t(p.x)) * 73856093) ^
+                   (size_t(uint32_t(p.y)) * 19349663) ^
+                   (size_t(uint32_t(p.z)) * 83492791);
+        }
+    };
+
+    unordered_map<ivec3, Page, PageHash> pages;
+    int _page_size, shift;
+    Generator generator;
+    string cache_dir; // empty for no cache
+    string cache_key; // what the pages depend on other than their size
+
+    Page& page(ivec3 p); // loading it if needed
+    string page_path(ivec3 p) const;
+    uint64_t page_key() const;
+    void unload(ivec3 p, Page&);
+
+    // loaded pages intersecting b, calling f(page, grid) with b in page-local
+    // coordinates
+    template<typename F>
+    void each_page(Box b, F&& f) const;
+
+public:
+    // page_size must be a power of two. Pages cached with another cache_key
+    // are generated again, so it should name the generator and whatever it
+    // depends on, such as a seed.
+    World(int page_size, Generator = {}, string cache_dir = {},
+          string cache_key = {});
+    ~World(); // saves modified pages
+
+    int page_size() const { return _page_size; }
+
+    // Floor division, so that page_of(-1) is -1 rather than 0.
+    ivec3 page_of(ivec3 p) const { return p >> shift; }
+    SBox page_box(ivec3 page) const {
+        return SBox{_page_size} + page * _page_size;
+    }
+    Box pages_of(Box b) const { // pages intersecting b
+        return Box::ranged(page_of(b.p0()), page_of(b.p1() - 1) + 1);
+    }
+
+    size_t loaded() const { return pages.size(); }
+    bool is_loaded(ivec3 page) const { return pages.count(page); }
+
+    // The grid of a page, loaded if needed. Coordinates are page-local.
+    Grid& grid(ivec3 p) { return page(p).grid; }
+
+    // Unload the pages that don't intersect any of the areas, saving them to
+    // the cache if they changed since they were loaded. Before that leaving
+    // is called with each of them, and may replace its grid with the one that
+    // has the latest edits. Pages are loaded as they are asked for, as by
+    // load() or grid().
+    void focus(const vector<Box>& areas,
+               const function<void(ivec3, Grid&)>& leaving = {});
+    void load(Box b); // pages intersecting b
+
+    // Edits load the pages they touch.
+    void fill(Box, Tile);
+    void cut(Box b) { fill(b, Tile::empty()); }
+    void apply(const EditBatch&);
+
+    // Tiles of loaded pages within bound, in world coordinates, page by page.
+    template<typename F>
+    void each_tile(Box bound, F&& f) const;
+
+    // loaded pages intersecting b, with their origins, see View::each_tile
+    vector<pair<ivec3, const Grid*>> pages_in(Box b) const;
+
+    // First non-empty tile along a ray through loaded pages, see
+    // ConstCursor::raycast.
+    optional<RayHit> raycast(dvec3 origin, dvec3 direction,
+                             double length) const;
+
+    View view(Box b) { return View(*this, b); }
+
+    friend class WorldCursor;
+};
+
+
+// Cursor for an aligned cube of world space, which may span many pages. Above
+// the page size it divides into smaller cubes the way a branch does, and at
+// the page size it goes on into the page's grid, so an octree walk can go
+// across page boundaries as if the world were one grid. Pages that aren't
+// loaded are null. Reads only, and doesn't load anything.
+
+class WorldCursor {
+    const World& world;
+    SBox s; // world coordinates
+
+    // loaded page below, if any, with its origin
+    const Grid* page(ivec3& origin) const;
+
+public:
+    WorldCursor(const World& world, SBox s) : world(world), s(s) {
+        assert(s.size() >= world.page_size() &&
+               glm::all(glm::equal(s.p0() & (s.size() - 1), ivec3(0))));
+    }
+
+    SBox box() const { return s; }
+    bool is_page() const { return s.size() == world.page_size(); }
+
+    // no page below is loaded
+    bool is_null() const;
+
+    WorldCursor operator[](ioct i) const {
+        assert(!is_page());
+        return { world, s.leaf(i) };
+    }
+
+    // The page's cursor, with coordinates relative to box().p0(), or none if
+    // the page isn't loaded.
+    optional<Grid::const_cursor> grid() const {
+        assert(is_page());
+        ivec3 origin;
+        if (auto g = page(origin))
+            return g->ctop();
+        return {};
+    }
+
+    // Tiles within bound, in world coordinates, in the order of coord_less,
+    // as if the world were one grid.
+    template<typename F>
+    void each_tile(Box bound, F&& f) const {
+        if (!bound.intersects(s) || is_null())
+            return;
+        if (!is_page()) {
+            for (auto i: ioct::all())
+                (*this)[i].each_tile(bound, f);
+            return;
+        }
+        ivec3 origin;
+        if (auto g = page(origin))
+            g->ctop().each_tile(bound - origin, [&] (SBox b, Tile t) {
+                f(b + origin, t);
+            });
+    }
+};
+
+
+template<typename F>
+void
+World::each_page(Box b, F&& f) const
+{
+    if (b.empty())
+        return;
+    for (auto p: pages_of(b).coords()) {
+        auto it = pages.find(p);
+        if (it != pages.end())
+            f(p, it->second.grid, b - p * _page_size);
+    }
+}
+
+template<typename F>
+void
+World::each_tile(Box bound, F&& f) const
+{
+    each_page(bound, [&] (ivec3 p, const Grid& grid, Box local) {
+        ivec3 origin = p * _page_size;
+        grid.ctop().each_tile(local, [&] (SBox s, Tile t) {
+            f(s + origin, t);
+        });
+    });
+}
+
+
+#endif
@@ -98,13 +98,29 @@ Craft::before_tick()
 
     double level = 5;
 
-    for (auto& t: thrusters) {
-        ode::Ray ray(level*2, bl * t.l);
-        // TODO: allow gliding over sprites as well as voxels
-        auto hit = ray.hit(island->voxel_space);
-        if (t.hit = bool(hit)) {
-            t.distance = hit->distance;
+    // Thrusters all point the same way, so they are cast against the grid as
+    // one packet, and only again once the craft has moved noticeably or the
+    // tiles below it were edited.
+    // TODO: allow gliding over sprites as well as voxels
+    if (!probed || glm::distance(bl.p, probed->p) > .02 ||
+            std::abs(glm::dot(bl.q, probed->q)) < 1 - 1e-6 ||
+            island->changed(probed_generations, probed_bound)) {
+        RayPacket packet(bl.q * thrusters[0].l.q * dvec3(0, 0, -1), level*2);
+        for (auto& t: thrusters) {
+            assert(t.l.q == thrusters[0].l.q);
+            packet.add((bl * t.l).p + dvec3(island->origin));
+        }
+        island->raycast(packet);
+        for (int i = 0; i < packet.size(); i++)
+            if (thrusters[i].hit = bool(packet[i]))
+                thrusters[i].distance = packet[i]->distance;
+        probed = bl;
+        probed_generations = island->generations();
+        probed_bound = packet.bound();
+    }
 
+    for (auto& t: thrusters) {
+        if (t.hit) {
             auto pv = body.velocity_at(t.l.p);
 
             // repel along -z axis, with dampening for stability
@@ -48,6 +48,11 @@ struct Craft : Sprite {
         bool hit;
         double distance;
     } thrusters[37];
+    // when thrusters were last cast: body location, and what the rays passed
+    // through, to cast again where the grid was edited
+    optional<dloc> probed;
+    Island::Generations probed_generations;
+    Box probed_bound{ivec3(0)};
 };
 
 
@@ -2,8 +2,10 @@
 
 #include "craft.h"
 #include "paint.h"
+#include "snapshot.h"
 
 #include <memory>
+#include <string>
 #include <utility>
 
 using std::move;
@@ -18,19 +20,32 @@ static Level::catalogue demo_entry(100, "Demo", [] { return new DemoLevel; });
 void
 DemoLevel::generate()
 {
-    grid = Grid(256);
+    // The key covers everything the terrain depends on. Bump version when
+    // the painters change what they make.
+    const int version = 2;
+    const int size = 256;
+    const uint32_t seed = 1;
+    uint64_t key = GridSnapshot::key(
+        "demo terrain version " + std::to_string(version) +
+        " size " + std::to_string(size) + " seed " + std::to_string(seed));
+    if (!load_grid("demo.grid", key)) {
+        grid = Grid(size);
 
-    auto v = View(grid);
-    v.fill(Tile{}.color({15, 10, 0}));
+        auto v = View(grid);
+        v.fill(Tile{}.color({15, 10, 0}));
 
-    v = v.center().clip_up();
-    v.cut();
-    rolling_hills_smooth(
-        v.translate(ivec3(0, 7, 0)).
-            rotate(irot::flip_y()).clip_up().rotate(irot::flip_y()).base(),
-        Tile{}.color({0, 24, 15}));
-    trees(v);
+        v = v.center().clip_up();
+        v.cut();
+        rolling_hills_smooth(
+            v.translate(ivec3(0, 7, 0)).
+                rotate(irot::flip_y()).clip_up().rotate(irot::flip_y()).base(),
+            Tile{}.color({0, 24, 15}));
+        trees(v, seed);
 
+        save_grid("demo.grid", key);
+    }
+
+    auto v = View(grid).center().clip_up();
     craft = sea.create<Craft>(v.location({dvec3(0, 10, 3)}));
     craft->init_controls(controls);
 }
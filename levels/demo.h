@@ -7,6 +7,7 @@ class Craft;
 
 
 class DemoLevel : public Level {
+protected:
     Craft* craft = {};
 
 public:
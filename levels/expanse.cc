@@ -0,0 +1,51 @@
+#include "expanse.h"
+
+#include "craft.h"
+#include "paint.h"
+
+#include <memory>
+#include <string>
+
+using std::to_string;
+
+using namespace paint;
+
+
+static Level::catalogue expanse_entry(110, "Expanse",
+                                      [] { return new ExpanseLevel; });
+
+
+void
+ExpanseLevel::generate()
+{
+    // Pages are cached under a key that covers everything they depend on.
+    // Bump version when the generator changes what it makes.
+    const int version = 1;
+    const int size = 1 << 14, page = 64;
+    const int ground = 2 * page, hills = 32; // so the hills are in one page
+    const uint32_t seed = 1;
+    string key = "expanse version " + to_string(version) +
+                 " ground " + to_string(ground) + " hills " +
+                 to_string(hills) + " seed " + to_string(seed);
+
+    auto generator = [=] (View v) {
+        Box b = v.model_box();
+        if (b.y0() < ground)
+            v.clip(Box::ranged(b.p0(), ivec3(b.x1(), ground, b.z1()))).fill(
+                Tile{}.color({15, 10, 0}));
+        View surface = v.translate(ivec3(0, ground, 0));
+        rolling_hills_plane(surface, hills, Tile{}.color({0, 24, 15}));
+        if (b.y0() == ground) {
+            // each page's trees the same whenever it is generated
+            ivec3 p = b.p0() / page;
+            trees(surface.clip_up(),
+                  seed ^ uint32_t(p.x) * 73856093 ^ uint32_t(p.z) * 83492791);
+        }
+    };
+    use_world(size, unique_ptr<World>(new World(
+        page, generator, cache_dir("expanse"), key)));
+
+    auto v = View(grid).translate(ivec3(size / 2, ground + hills, size / 2));
+    craft = sea.create<Craft>(v.location({dvec3(0, 10, 3)}));
+    craft->init_controls(controls);
+}
@@ -0,0 +1,16 @@
+#ifndef LEVELS_EXPANSE_H
+#define LEVELS_EXPANSE_H
+
+#include "demo.h"
+
+
+// The demo craft over hills that go on across the whole grid, which is set in
+// a World so that only the pages around the craft are kept.
+
+class ExpanseLevel : public DemoLevel {
+public:
+    void generate();
+};
+
+
+#endif
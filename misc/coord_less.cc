@@ -1,5 +1,8 @@
 // coord_less is a comparator that corresponds to the order in which the grid is
-// recursively traversed. This file checks the calculation correctness.
+// recursively traversed. This file checks the calculation correctness, both of
+// the original bit-by-bit comparison and of the Morton key that replaced it.
+
+#include "../core/morton.h"
 
 #include <cassert>
 
@@ -35,6 +38,13 @@ comp(ivec3 a, ivec3 b)
 }
 
 
+bool
+morton_comp(ivec3 a, ivec3 b)
+{
+    return Morton(a) < Morton(b);
+}
+
+
 bool
 equiv(ivec3 a, ivec3 b)
 {
@@ -52,10 +62,12 @@ check_compare_concept()
     for (a.z = 0; a.z < size; a.z++) {
         assert(!comp(a, a));
         assert(equiv(a, a));
+        assert(Morton(a).coord() == a);
 
         for (b.x = 0; b.x < size; b.x++)
         for (b.y = 0; b.y < size; b.y++)
         for (b.z = 0; b.z < size; b.z++) {
+            assert(morton_comp(a, b) == comp(a, b));
             if (comp(a, b))
                 assert(!comp(b, a));
             if (equiv(a, b))
@@ -80,8 +92,10 @@ check_traversal()
     struct Traverse {
         ivec3 last = ivec3(-1);
         void traverse(ivec3 p, int d) {
-            if (last.x >= 0)
+            if (last.x >= 0) {
                 assert(last == p || comp(last, p));
+                assert(last == p || morton_comp(last, p));
+            }
             last = p;
 
             if (d > 1) {
@@ -99,9 +113,26 @@ check_traversal()
 }
 
 
+// coordinates beyond the small range above
+void
+check_morton_range()
+{
+    int top = (1 << Morton::bits) - 1;
+    for (int i = 0; i < Morton::bits; i++) {
+        ivec3 a(1 << i, top - (1 << i), top);
+        ivec3 b(top, 1 << i, 0);
+        assert(Morton(a).coord() == a);
+        assert(Morton(b).coord() == b);
+        assert(morton_comp(a, b) == comp(a, b));
+        assert(morton_comp(b, a) == comp(b, a));
+    }
+}
+
+
 int
 main()
 {
     check_compare_concept();
     check_traversal();
+    check_morton_range();
 }
@@ -1,7 +1,11 @@
 #include "box.h"
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <list>
+#include <random>
+#include <vector>
 
 using std::cout;
 using std::list;
@@ -9,9 +13,103 @@ using std::list;
 using namespace pgamecc;
 
 
+// box sets must cover the same cells as the combinations would cell by cell,
+// with disjoint boxes
+void check_box_set()
+{
+    std::mt19937 random;
+    auto coord = [&] (int n) { return int(random() % n); };
+    auto box = [&] {
+        ivec3 p(coord(16), coord(16), coord(16));
+        return Box::ranged(p, glm::min(p + 1 + ivec3(coord(8), coord(8),
+                                                     coord(8)), ivec3(16)));
+    };
+    auto at = [] (ivec3 p) { return (p.z * 16 + p.y) * 16 + p.x; };
+    auto cells = [&] (const BoxSet& s) {
+        std::vector<bool> v(16*16*16);
+        for (size_t i = 0; i < s.size(); i++)
+            for (auto p: s[i].coords()) {
+                assert(!v[at(p)]);
+                v[at(p)] = true;
+            }
+        return v;
+    };
+    auto count = [] (const std::vector<bool>& v) {
+        return std::count(v.begin(), v.end(), true);
+    };
+
+    BoxSet sets[2];
+    std::vector<bool> expect[2] = { std::vector<bool>(16*16*16),
+                                    std::vector<bool>(16*16*16) };
+    for (int i = 0; i < 400; i++) {
+        BoxSet& s = sets[i % 2];
+        auto& v = expect[i % 2];
+        Box r = box();
+        int op = coord(8);
+        if (op < 5)
+            s |= r;
+        else if (op < 7)
+            s -= r;
+        else
+            s &= r;
+        for (auto p: Box{ivec3(16)}.coords()) {
+            bool in = r.contains(p + Box{ivec3(1)});
+            v[at(p)] = op < 5 ? v[at(p)] || in :
+                       op < 7 ? v[at(p)] && !in : v[at(p)] && in;
+        }
+        assert(cells(s) == v && s.volume() == count(v));
+
+        Box q = box();
+        bool any = false, all = true;
+        for (auto p: q.coords()) {
+            any |= v[at(p)];
+            all &= v[at(p)];
+        }
+        assert(s.intersects(q) == any && s.contains(q) == all);
+    }
+
+    auto combine = [&] (auto f) {
+        std::vector<bool> v(16*16*16);
+        for (size_t i = 0; i < v.size(); i++)
+            v[i] = f(bool(expect[0][i]), bool(expect[1][i]));
+        return v;
+    };
+    assert(cells(sets[0] | sets[1]) ==
+           combine([] (bool a, bool b) { return a || b; }));
+    assert(cells(sets[0] - sets[1]) ==
+           combine([] (bool a, bool b) { return a && !b; }));
+    assert(cells(sets[0] & sets[1]) ==
+           combine([] (bool a, bool b) { return a && b; }));
+
+    // boxes making up a larger one are joined
+    BoxSet j;
+    j |= Box{ivec3(2, 4, 4)};
+    j |= Box{ivec3(2, 4, 4)} + ivec3(2, 0, 0);
+    j |= Box{ivec3(4, 4, 4)} + ivec3(0, 4, 0);
+    assert(j.size() == 1 && j[0] == Box{ivec3(4, 8, 4)});
+    j -= Box{ivec3(4, 8, 4)};
+    assert(j.empty() && j.bound().empty());
+
+    // many boxes added and joined once cover the same cells
+    BoxSet u;
+    std::vector<bool> w(16*16*16);
+    for (int i = 0; i < 100; i++) {
+        Box r = box();
+        u.add(r);
+        for (auto p: r.coords())
+            w[at(p)] = true;
+    }
+    size_t unjoined = u.size();
+    u.coalesce();
+    assert(cells(u) == w && u.size() <= unjoined);
+}
+
+
 int
 main()
 {
+    check_box_set();
+
     ivec3 v(1, 2, 3);
 
     cout << v << '\n';
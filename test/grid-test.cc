@@ -1,7 +1,38 @@
+#include "builder.h"
 #include "grid.h"
+#include "packed.h"
+#include "paint.h"
+#include "snapshot.h"
+#include "world.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+using std::vector;
 
 Grid grid;
 
+// one random sequence for all the checks, the same on every run
+std::mt19937 rng;
+
+int coord(int n) { return int(rng() % n); }
+
+// a grid of the given size that is all empty, rather than null
+Grid cleared_grid(int size)
+{
+    Grid g(size);
+    g.top().cut(SBox{size});
+    return g;
+}
+
 void show()
 {
     list<Box> boxes;
@@ -22,9 +53,892 @@ void letter_f(View v)
     v.translate({0, 2, 0}).clip(Box({3, 1, 1})).fill({});
 }
 
+template<typename A, typename B>
+void check_same(const A& a, const B& b)
+{
+    vector<pair<SBox, Tile>> ta, tb;
+    a.ctop().each_tile(SBox{a.size()}, [&] (SBox s, Tile t) {
+        ta.emplace_back(s, t);
+    });
+    b.ctop().each_tile(SBox{b.size()}, [&] (SBox s, Tile t) {
+        tb.emplace_back(s, t);
+    });
+    assert(ta.size() == tb.size());
+    for (size_t j = 0; j < ta.size(); j++)
+        assert(ta[j].first == tb[j].first && ta[j].second == tb[j].second);
+}
+
+// fill() must build exactly the same tree as the reference implementation,
+// and so must a batch of the same edits
+void check_fill()
+{
+    Grid a = cleared_grid(32), b = cleared_grid(32), c = cleared_grid(32);
+    EditBatch batch;
+    Tile tiles[] = { Tile{}, Tile{}.color({31, 0, 0}), Tile::empty() };
+    for (int i = 0; i < 1000; i++) {
+        ivec3 p0(coord(36) - 2, coord(36) - 2, coord(36) - 2);
+        ivec3 p1 = p0 + 1 + ivec3(coord(i % 10 ? 4 : 20), coord(16), coord(16));
+        Tile t = tiles[coord(3)];
+        a.top().fill(Box::ranged(p0, p1), t);
+        b.top().fill_reference(Box::ranged(p0, p1), t);
+        check_same(a, b);
+
+        batch.fill(Box::ranged(p0, p1), t);
+        if (i % 100 == 99) {
+            c.apply(batch);
+            batch.clear();
+            check_same(a, c);
+        }
+    }
+}
+
+// a packed grid updated after each edit must match the grid and a fresh copy
+void check_packed()
+{
+    Grid a = cleared_grid(32);
+    PackedGrid p(a);
+    Tile tiles[] = { Tile{}, Tile{}.color({0, 31, 0}), Tile::empty() };
+    for (int i = 0; i < 300; i++) {
+        ivec3 p0(coord(34) - 1, coord(34) - 1, coord(34) - 1);
+        ivec3 p1 = p0 + 1 + ivec3(coord(12), coord(12), coord(12));
+        Box b = Box::ranged(p0, p1);
+        a.top().fill(b, tiles[coord(3)]);
+        p.update(a, b);
+        check_same(a, p);
+        assert(p.words() <= 2 * PackedGrid(a).words());
+    }
+}
+
+// a saved snapshot opens only with its key and matches in place and unpacked
+void check_snapshot()
+{
+    Grid a(8);
+    letter_f(View(a));
+    const char* path = "grid-test.snapshot";
+    auto key = GridSnapshot::key("letter f");
+    bool saved = GridSnapshot::save(path, PackedGrid(a), key);
+    assert(saved);
+    {
+        GridSnapshot s(path, key);
+        assert(s);
+        check_same(a, s);
+        check_same(a, s.unpack());
+        assert(!GridSnapshot(path, key + 1));
+    }
+
+    // a damaged size in the header, which is at byte 12, must fail to open
+    // rather than let branches go on below size 1
+    for (int32_t size: { 6, 1 }) {
+        FILE* f = fopen(path, "r+b");
+        assert(f);
+        fseek(f, 12, SEEK_SET);
+        fwrite(&size, sizeof size, 1, f);
+        fclose(f);
+        assert(!GridSnapshot(path, key));
+    }
+    std::remove(path);
+    assert(!GridSnapshot(path, key));
+}
+
+// a deduplicated grid must look the same and stay the same as a plain one
+// through edits that copy shared branches
+void check_deduplicate()
+{
+    Grid a = cleared_grid(32), b = cleared_grid(32);
+    for (auto g: { &a, &b })
+        for (auto p: Box{ivec3(4)}.coords())
+            letter_f(View(*g).clip(p * 8 + SBox{8}).base());
+    size_t live = BranchPool::stats().branches;
+    a.deduplicate();
+    assert(BranchPool::stats().branches < live);
+    check_same(a, b);
+
+    Tile tiles[] = { Tile{}, Tile{}.color({0, 0, 31}), Tile::empty() };
+    for (int i = 0; i < 300; i++) {
+        ivec3 p0(coord(34) - 1, coord(34) - 1, coord(34) - 1);
+        ivec3 p1 = p0 + 1 + ivec3(coord(6), coord(6), coord(6));
+        Box box = Box::ranged(p0, p1);
+        Tile t = tiles[coord(3)];
+        a.top().fill(box, t);
+        b.top().fill(box, t);
+        check_same(a, b);
+        if (i % 50 == 0)
+            a.deduplicate();
+    }
+}
+
+// a shared copy keeps its contents while the original is edited, and the
+// other way round
+void check_share()
+{
+    Grid a = cleared_grid(32), b = cleared_grid(32);
+    Tile tiles[] = { Tile{}, Tile{}.color({31, 31, 0}), Tile::empty() };
+    for (int i = 0; i < 100; i++) {
+        ivec3 p0(coord(34) - 1, coord(34) - 1, coord(34) - 1);
+        ivec3 p1 = p0 + 1 + ivec3(coord(12), coord(12), coord(12));
+        Box box = Box::ranged(p0, p1);
+        Tile t = tiles[coord(3)];
+        Grid& g = i % 2 ? a : b;
+
+        PackedGrid before(g);
+        Grid shared = g.share();
+        g.top().fill(box, t);
+        check_same(shared, before);
+        shared.top().fill(box, t);
+        check_same(shared, g);
+    }
+}
+
+// the journal lists edits since a generation, and a packed grid can follow it
+void check_journal()
+{
+    Grid a = cleared_grid(32);
+    PackedGrid p(a);
+    uint64_t g0 = a.changes().generation();
+
+    a.top().fill(Box{ivec3(4)}, Tile{});
+    uint64_t g1 = a.changes().generation();
+    assert(g1 > g0);
+    EditBatch batch;
+    batch.fill(ivec3(20) + Box{ivec3(2)}, Tile{});
+    batch.cut(ivec3(1) + Box{ivec3(1)});
+    a.apply(batch);
+
+    assert(a.changes().changed(g0, SBox{4}));
+    assert(!a.changes().changed(g1, SBox{4} + ivec3(8)));
+    assert(a.changes().changed(g1, SBox{1} + ivec3(1)));
+    assert(!a.changes().changed(a.changes().generation(), SBox{32}));
+    int n = 0;
+    a.changes().each_change(g1, SBox{16}, [&] (Box b) {
+        assert(b == ivec3(1) + Box{ivec3(1)});
+        n++;
+    });
+    assert(n == 1);
+
+    // the shared copy knows its generation but not the edits before it
+    Grid b = a.share();
+    assert(b.changes().changed(g1, SBox{4} + ivec3(8)));
+    assert(!b.changes().changed(b.changes().generation(), SBox{32}));
+
+    p.update(a);
+    check_same(a, p);
+
+    // a generation from a grid that was replaced is older than any edit of
+    // the new one, however few edits that has had
+    Grid c = cleared_grid(32);
+    PackedGrid q(c);
+    c = Grid(32, Tile{});
+    c.top().cut(SBox{1});
+    q.update(c);
+    check_same(c, q);
+}
+
+// raycast must find the same first hit as testing every tile separately
+void check_raycast()
+{
+    auto real = [&] { return rng() / double(rng.max()) * 2 - 1; };
+
+    Grid a = cleared_grid(16);
+    Tile tiles[] = { Tile{}, Tile{}.shape(boct{0x3f}), Tile{}.shape(boct{0x17}),
+                     Tile{}.shape(boct{0xfe}) };
+    for (int i = 0; i < 20; i++) {
+        ivec3 p(coord(16), coord(16), coord(16));
+        int size = 1 + coord(3);
+        Tile t = tiles[coord(4)];
+        a.top().fill(p + Box{ivec3(t.shape() ? 1 : size)}, t);
+    }
+
+    // distance to a tile, or -1 if missed
+    auto hit_tile = [] (dvec3 o, dvec3 d, SBox s, Tile t) {
+        double t0 = 0, t1 = 100;
+        for (int k = 0; k < 3; k++) {
+            double ta = (s.p0()[k] - o[k]) / d[k],
+                   tb = (s.p1()[k] - o[k]) / d[k];
+            t0 = max(t0, min(ta, tb));
+            t1 = min(t1, max(ta, tb));
+        }
+        if (t.shape()) {
+            dvec4 plane = t.shape_plane();
+            auto f = [&] (double u) {
+                dvec3 p = (o + d * u - dvec3(s.p0())) / double(s.size());
+                return glm::dot(dvec3(plane), p) + plane.w;
+            };
+            if (f(t0) < 0) {
+                if (f(t1) < 0)
+                    return -1.;
+                t0 += (t1 - t0) * -f(t0) / (f(t1) - f(t0));
+            }
+        }
+        return t0 <= t1 ? t0 : -1.;
+    };
+
+    for (int i = 0; i < 1000; i++) {
+        dvec3 o(real() * 12 + 8, real() * 12 + 8, real() * 12 + 8);
+        dvec3 d = glm::normalize(dvec3(real(), real(), real()));
+        double best = -1;
+        a.ctop().each_tile(SBox{16}, [&] (SBox s, Tile t) {
+            double u = hit_tile(o, d, s, t);
+            if (u >= 0 && (best < 0 || u < best))
+                best = u;
+        });
+        auto hit = a.raycast(o, d, 100);
+        assert(bool(hit) == best >= 0);
+        if (hit) {
+            assert(std::fabs(hit->distance - best) < 1e-9);
+            dvec3 p0(hit->box.p0()), p1(hit->box.p1());
+            assert(glm::all(glm::greaterThanEqual(hit->p, p0 - 1e-9)) &&
+                   glm::all(glm::lessThanEqual(hit->p, p1 + 1e-9)));
+        }
+    }
+
+    // a packet must give the same hits as casting each ray alone
+    for (int i = 0; i < 100; i++) {
+        dvec3 d = glm::normalize(dvec3(real(), real(), real()));
+        if (i % 10 == 0)
+            d = dvec3(0, -1, 0); // axis-aligned, as for thrusters
+        RayPacket packet(d, 30);
+        vector<dvec3> origins;
+        for (int j = 0; j < 37; j++)
+            origins.push_back(
+                dvec3(real() * 12 + 8, real() * 12 + 8, real() * 12 + 8));
+        for (auto o: origins)
+            packet.add(o);
+        a.raycast(packet);
+        for (int j = 0; j < 37; j++) {
+            auto hit = a.raycast(origins[j], d, 30);
+            assert(bool(hit) == bool(packet[j]));
+            if (hit)
+                assert(std::fabs(hit->distance - packet[j]->distance) < 1e-9);
+        }
+    }
+}
+
+// the tile range must list the same tiles as each_tile, for any bound
+void check_tiles()
+{
+    Grid a = cleared_grid(32);
+    for (int i = 0; i < 100; i++) {
+        ivec3 p(coord(32), coord(32), coord(32));
+        a.top().fill(p + Box{ivec3(1 + coord(8))},
+                     Tile{}.color({coord(32), 0, 0}));
+    }
+    PackedGrid p(a);
+
+    for (int i = 0; i < 100; i++) {
+        ivec3 p0(coord(34) - 1, coord(34) - 1, coord(34) - 1);
+        Box b = Box::ranged(p0, p0 + 1 + ivec3(coord(20)));
+        vector<pair<SBox, Tile>> ta, tb, tc;
+        a.ctop().each_tile(b, [&] (SBox s, Tile t) { ta.emplace_back(s, t); });
+        for (auto st: a.ctop().tiles(b))
+            tb.push_back(st);
+        for (auto st: p.ctop().tiles(b))
+            tc.push_back(st);
+        assert(ta.size() == tb.size() && ta.size() == tc.size());
+        for (size_t j = 0; j < ta.size(); j++)
+            assert(ta[j].first == tb[j].first && ta[j].second == tb[j].second &&
+                   ta[j].first == tc[j].first && ta[j].second == tc[j].second);
+    }
+
+    // a tile at the root, and nothing at all
+    Grid b(4);
+    b.top().fill(SBox{4}, Tile{});
+    int n = 0;
+    for (auto st: b.ctop().tiles(SBox{4})) {
+        assert(st.first == SBox{4});
+        n++;
+    }
+    assert(n == 1);
+    b.top().cut(SBox{4});
+    assert(b.ctop().tiles(SBox{4}).begin() == b.ctop().tiles(SBox{4}).end());
+}
+
+// What is below a node, found the slow way, checking branch summaries on the
+// way where they are valid.
+struct Below {
+    bool occupied, solid, shaped;
+    int min_hp, max_hp;
+};
+
+Below check_below(Grid::const_cursor c)
+{
+    if (c.is_null() || c.is_tile() && !c.tile())
+        return { false, false, false, 7, 0 };
+    if (c.is_tile()) {
+        Tile t = c.tile();
+        return { true, !t.shape(), bool(t.shape()), t.hp(), t.hp() };
+    }
+    BranchSummary s = c.summary();
+    Below r{ false, true, false, 7, 0 };
+    for (auto i: ioct::all()) {
+        Below b = check_below(c[i]);
+        if (s.valid)
+            assert(bool(s.occupied >> i.i() & 1) == b.occupied &&
+                   bool(s.solid >> i.i() & 1) == b.solid);
+        r.occupied |= b.occupied;
+        r.solid &= b.solid;
+        r.shaped |= b.shaped;
+        r.min_hp = min(r.min_hp, b.min_hp);
+        r.max_hp = max(r.max_hp, b.max_hp);
+    }
+    if (s.valid)
+        assert(bool(s.shaped) == r.shaped &&
+               int(s.min_hp) == r.min_hp && int(s.max_hp) == r.max_hp);
+    assert(c.is_vacant() <= !r.occupied);
+    assert(c.is_solid() <= r.solid);
+    assert(c.is_unshaped() <= !r.shaped);
+    return r;
+}
+
+// summaries must stay correct through every kind of edit, including ones
+// through a cursor that descended without coming back up
+void check_summary()
+{
+    auto tile = [&] {
+        switch (coord(5)) {
+        case 0: return Tile::empty();
+        case 1: return Tile{}.invulnerable();
+        default: return Tile{}.hp(1 + coord(6)).color({coord(32), 0, 0});
+        }
+    };
+
+    Grid a = cleared_grid(32);
+    for (int i = 0; i < 400; i++) {
+        Grid b; // shared with a for a while
+        if (i % 10 == 0)
+            b = a.share();
+
+        ivec3 p(coord(32), coord(32), coord(32));
+        Box box = p + Box{ivec3(1 + coord(8))};
+        switch (i % 5) {
+        case 0:
+            a.top().fill(box, tile());
+            break;
+        case 1: {
+            EditBatch batch;
+            for (int j = 0; j < 5; j++) {
+                ivec3 q(coord(32), coord(32), coord(32));
+                batch.fill(q + Box{ivec3(1 + coord(4))}, tile());
+            }
+            a.apply(batch);
+            break;
+        }
+        case 2:
+            a.top().fill_reference(box, tile());
+            break;
+        case 3:
+            // a unique tile keeps the path down to it subdivided
+            a.top().fill(p + SBox{1}, Tile{}.color({31, 31, 31}));
+            a.top().find(SBox{8} + p / 8 * 8).fill(box, tile());
+            break;
+        case 4:
+            a.top().fill(p + SBox{1},
+                         Tile{}.hp(1 + coord(6)).shape(boct{coord(256)}));
+            break;
+        }
+        check_below(a.ctop());
+        if (i % 10 == 0)
+            check_below(b.ctop());
+    }
+
+    // an edit from the top brings invalid summaries below it up to date
+    a.top().fill(SBox{1}, Tile{});
+    assert(a.ctop().summary().valid);
+    check_below(a.ctop());
+
+    Grid c = cleared_grid(8);
+    c.top().fill(SBox{4}, Tile{}.color({1, 0, 0}));
+    c.top().fill(SBox{4} + ivec3(4, 0, 0), Tile{}.color({2, 0, 0}));
+    assert(c.ctop().occupied() == 0x03 && !c.ctop().is_solid());
+    c.top().fill(SBox{8}, Tile{}.color({1, 0, 0}));
+    c.top().fill(SBox{4}, Tile{}.color({2, 0, 0}));
+    assert(c.ctop().is_solid() && c.ctop().is_unshaped());
+    c.top().fill(SBox{1}, Tile{}.shape(boct{0x7f}));
+    assert(!c.ctop().is_solid() && !c.ctop().is_unshaped());
+    c.top().cut(Box{ivec3(8, 4, 8)});
+    assert(c.ctop().occupied() == 0xcc && !c.ctop().is_vacant());
+    c.top().cut(SBox{8});
+    assert(c.ctop().is_vacant());
+}
+
+// painting each part of a split grid on its own must give the same grid as
+// painting it whole, and leave it merged as if it had been
+void check_split()
+{
+    for (int depth: { 0, 1, 2, 3 }) {
+        vector<pair<Box, Tile>> fills;
+        for (int i = 0; i < 100; i++) {
+            ivec3 p(coord(36) - 2, coord(36) - 2, coord(36) - 2);
+            fills.emplace_back(p + Box{ivec3(1 + coord(12))},
+                               coord(3) ? Tile{}.color({coord(4), 0, 0})
+                                        : Tile::empty());
+        }
+        fills.emplace_back(SBox{16}, Tile{});
+
+        Grid a(32), b(32);
+        View va = View(a).clip(Box::ranged(ivec3(1, 2, 3), ivec3(30, 31, 32)));
+        View vb = View(b).clip(Box::ranged(ivec3(1, 2, 3), ivec3(30, 31, 32)));
+        va.fill({});
+        vb.fill({});
+        for (auto& f: fills)
+            va.clip(f.first).fill(f.second);
+        uint64_t generation = b.changes().generation();
+        vb.parallel(depth, [&] (View part, Box m) {
+            assert(vb.model_box().contains(m));
+            for (auto& f: fills)
+                part.clip(f.first).fill(f.second);
+        });
+        check_same(a, b);
+        assert(b.changes().generation() > generation);
+        assert(PackedGrid(a).words() == PackedGrid(b).words());
+    }
+}
+
+// a grid built bottom-up from a tile stream must be the same as the grid the
+// stream came from, merged the same way, and painters that build must paint
+// the same as they would with fills
+void check_builder()
+{
+    Grid a = cleared_grid(32);
+    for (int i = 0; i < 200; i++) {
+        ivec3 p(coord(32), coord(32), coord(32));
+        Tile t = coord(4) ? Tile{}.color({coord(4), 0, 0})
+                          : Tile{}.shape(boct{0x7f});
+        int n = t.shape() ? 1 : 1 + coord(8);
+        a.top().fill(p + Box{ivec3(n)}, t);
+    }
+    GridBuilder builder(32);
+    for (auto st: a.ctop().tiles(SBox{32}))
+        builder.add(st);
+    Grid b = builder.grid();
+    check_same(a, b);
+    assert(PackedGrid(a).words() == PackedGrid(b).words());
+
+    // from a snapshot's tiles
+    PackedGrid packed(a);
+    GridBuilder from_packed(32);
+    for (auto st: packed.ctop().tiles(SBox{32}))
+        from_packed.add(st);
+    check_same(a, from_packed.grid());
+
+    // nothing at all, and one tile
+    Grid nothing = GridBuilder(8).grid();
+    assert(nothing.ctop().is_tile() && !nothing.ctop().tile());
+    GridBuilder one(8, Tile{});
+    Grid c = one.grid();
+    assert(c.ctop().is_tile() && c.ctop().tile() == Tile{});
+
+    // a ball, painted by cells and by blocks
+    auto inside = [] (ivec3 p) {
+        ivec3 d = p * 2 + 1 - 32;
+        return glm::dot(d, d) < 26 * 26;
+    };
+    Grid d = cleared_grid(32), e = cleared_grid(32);
+    View vd = View(d).clip(Box::ranged(ivec3(2), ivec3(30)));
+    EditBatch batch;
+    for (auto p: vd.model_box().coords())
+        if (inside(p))
+            batch.fill(p + SBox{1}, Tile{});
+    d.apply(batch);
+    bool built = View(e).clip(Box::ranged(ivec3(2), ivec3(30))).build(
+        [&] (Box m) {
+            int n = 0;
+            for (auto p: m.coords())
+                n += inside(p);
+            if (!n)
+                return BuildBlock{ BuildBlock::background };
+            if (n == glm::compMul(m.size()))
+                return BuildBlock{ BuildBlock::fill, Tile{} };
+            return BuildBlock{ BuildBlock::mixed };
+        });
+    assert(built);
+    check_same(d, e);
+    assert(PackedGrid(d).words() == PackedGrid(e).words());
+    assert(!View(e).build([] (Box) { return BuildBlock{}; }));
+
+    // heightmaps build within a cut grid, and fill where it isn't uniform;
+    // here the bottom parts have tiles that the terrain covers
+    auto h = pgamecc::make_image(ivec2(33), [&] (ivec2) {
+        return 1 + coord(20);
+    });
+    Grid f = cleared_grid(32), g = cleared_grid(32);
+    for (int x = 0; x < 32; x += 4)
+        for (int z = 0; z < 32; z += 4)
+            g.top().fill(ivec3(x, 0, z) + SBox{1}, Tile{}.color({1, 0, 0}));
+    paint::heightmap_smooth(View(f), h, Tile{});
+    paint::heightmap_smooth(View(g), h, Tile{});
+    check_same(f, g);
+    assert(PackedGrid(f).words() == PackedGrid(g).words());
+}
+
+// a world of pages, edited across page boundaries and negative coordinates,
+// must look the same as one grid covering the same space, also after its
+// pages are unloaded to the cache and loaded again
+void check_world()
+{
+    Box bound = Box::ranged(ivec3(-16), ivec3(16));
+    auto voxels = [&] (auto each_tile) {
+        vector<Tile> v(32*32*32, Tile::empty());
+        each_tile([&] (SBox s, Tile t) {
+            for (auto p: (Box{s} & bound).coords()) {
+                p += ivec3(16);
+                v[(p.z * 32 + p.y) * 32 + p.x] = t;
+            }
+        });
+        return v;
+    };
+
+    char dir[] = "grid-test.XXXXXX";
+    bool made = mkdtemp(dir);
+    assert(made);
+
+    Grid a = cleared_grid(32);
+    {
+        World w(8, {}, dir);
+        EditBatch batch;
+        for (int i = 0; i < 100; i++) {
+            ivec3 p(coord(32) - 16, coord(32) - 16, coord(32) - 16);
+            Box b = Box::ranged(p, glm::min(p + 1 + ivec3(coord(12)),
+                                            ivec3(16)));
+            Tile t = coord(4) ? Tile{}.color({coord(32), 0, 0})
+                              : Tile::empty();
+            a.top().fill(b + ivec3(16), t);
+            if (i % 2)
+                batch.fill(b, t);
+            else {
+                w.apply(exchange(batch, {}));
+                View(w, bound).clip(b).fill(t);
+            }
+        }
+        w.apply(batch);
+        assert(w.loaded() <= 64);
+
+        auto va = voxels([&] (auto f) {
+            a.ctop().each_tile(SBox{32}, [&] (SBox s, Tile t) {
+                f(s - ivec3(16), t);
+            });
+        });
+        assert(va == voxels([&] (auto f) { w.each_tile(bound, f); }));
+        assert(va == voxels([&] (auto f) { View(w, bound).each_tile(f); }));
+
+        // and so must cursors walking the pages as one tree, in order
+        assert(va == voxels([&] (auto f) {
+            for (auto i: ioct::all()) {
+                ivec3 p0 = (ivec3(i.bvec3_cast()) - 1) * 16;
+                optional<ivec3> last;
+                WorldCursor(w, SBox{16} + p0).each_tile(bound,
+                                                      [&] (SBox s, Tile t) {
+                    assert(!last || Grid::cursor::coord_less(*last - p0,
+                                                             s.p0() - p0));
+                    last = s.p0();
+                    f(s, t);
+                });
+            }
+        }));
+
+        for (int i = 0; i < 100; i++) {
+            dvec3 o(rng() % 320 / 10. - 16, rng() % 320 / 10. - 16,
+                    rng() % 320 / 10. - 16);
+            dvec3 d = glm::normalize(dvec3(coord(21) - 10, coord(21) - 10,
+                                           coord(21) - 10) + dvec3(.01));
+            auto hw = w.raycast(o, d, 40);
+            auto ha = a.raycast(o + dvec3(16), d, 40);
+            assert(bool(hw) == bool(ha));
+            if (hw)
+                assert(std::fabs(hw->distance - ha->distance) < 1e-9 &&
+                       hw->tile == ha->tile);
+        }
+
+        w.focus({ Box::ranged(ivec3(-16), ivec3(-8)) });
+        assert(w.loaded() == 1 && w.is_loaded(ivec3(-2)));
+        w.focus({});
+        assert(w.loaded() == 0);
+        assert(WorldCursor(w, SBox{16}).is_null());
+        w.load(bound);
+        assert(va == voxels([&] (auto f) { w.each_tile(bound, f); }));
+    }
+
+    // pages that aren't cached are generated in world coordinates
+    World g(8, [] (View v) {
+        v.clip(Box::ranged(ivec3(-100), ivec3(100, 0, 100))).fill({});
+    });
+    g.load(bound);
+    assert(g.loaded() == 64);
+    g.each_tile(bound, [&] (SBox s, Tile) { assert(s.p1().y <= 0); });
+    auto h = g.raycast(dvec3(.5, 10, .5), dvec3(0, -1, 0), 20);
+    assert(h && std::fabs(h->distance - 10) < 1e-9);
+
+    for (auto p: Box::ranged(ivec3(-2), ivec3(2)).coords()) {
+        std::ostringstream s;
+        s << dir << "/page." << p.x << '.' << p.y << '.' << p.z << ".grid";
+        std::remove(s.str().c_str());
+    }
+    rmdir(dir);
+}
+
+// an overlay must look like the grid below it until edited, and reads through
+// it, as well as merging it, must give what editing the grid would have
+void check_overlay()
+{
+    auto fill = [&] (auto&& edit) {
+        ivec3 p(coord(32), coord(32), coord(32));
+        edit(p + Box{ivec3(1 + coord(8))},
+             coord(3) ? Tile{}.color({coord(4), 0, 0}) : Tile::empty());
+    };
+
+    Grid base = cleared_grid(32);
+    for (int i = 0; i < 100; i++)
+        fill([&] (Box b, Tile t) { base.top().fill(b, t); });
+    Grid edited = base.share();
+    Grid overlay(32);
+    assert(overlay.ctop().is_null());
+    for (int i = 0; i < 50; i++)
+        fill([&] (Box b, Tile t) {
+            edited.top().fill(b, t);
+            overlay.top().fill(b, t);
+        });
+
+    for (int i = 0; i < 100; i++) {
+        dvec3 o(rng() % 320 / 10., rng() % 320 / 10.,
+                rng() % 320 / 10.);
+        dvec3 d = glm::normalize(dvec3(coord(21) - 10, coord(21) - 10,
+                                       coord(21) - 10) + dvec3(.01));
+        auto he = edited.raycast(o, d, 40);
+        auto ho = overlay.raycast(o, d, 40, base);
+        assert(bool(he) == bool(ho));
+        if (he)
+            assert(std::fabs(he->distance - ho->distance) < 1e-9 &&
+                   he->tile == ho->tile);
+
+        RayPacket pe(d, 40), po(d, 40);
+        for (int j = 0; j < 4; j++) {
+            dvec3 q = o + dvec3(j, 0, 0);
+            pe.add(q);
+            po.add(q);
+        }
+        edited.raycast(pe);
+        overlay.raycast(po, base);
+        for (int j = 0; j < 4; j++) {
+            assert(bool(pe[j]) == bool(po[j]));
+            if (pe[j])
+                assert(std::fabs(pe[j]->distance - po[j]->distance) < 1e-9 &&
+                       pe[j]->tile == po[j]->tile);
+        }
+    }
+
+    uint64_t generation = base.changes().generation();
+    base.merge(overlay);
+    assert(base.changes().generation() > generation);
+    check_same(base, edited);
+    assert(PackedGrid(base).words() == PackedGrid(edited).words());
+    base.merge(Grid(32));
+    check_same(base, edited);
+}
+
+// stats must count what is stored, shared branches once
+void check_stats()
+{
+    Grid a = cleared_grid(8);
+    GridStats s = a.stats();
+    assert(s.branches == 0 && s.leaves() == 1 && s.empty == 1 &&
+           s.leaves_at[3] == 1 && s.depth == 0 && s.merge_ratio() == 512);
+
+    a.top().fill(SBox{1}, Tile{});
+    a.top().fill(SBox{1} + ivec3(4, 0, 0), Tile{});
+    a.top().fill(SBox{1} + ivec3(7, 7, 7), Tile{}.shape(boct{0x7f}));
+    s = a.stats();
+    assert(s.branches == 7 && s.shared == 0 && s.bytes() == 7 * 72);
+    assert(s.branches_at[0] == 1 && s.branches_at[1] == 3 &&
+           s.branches_at[2] == 3 && s.depth == 3);
+    assert(s.cubes == 2 && s.shaped == 1 && s.empty == 5 + 3 * 7 + 3 * 7);
+    assert(s.leaves_at[0] == 24 && s.leaves_at[1] == 21 &&
+           s.leaves_at[2] == 5 && s.leaves() == 50);
+    assert(s.merge_ratio() == 512. / 50);
+
+    // the two subtrees with a cube are the same
+    a.deduplicate();
+    s = a.stats();
+    assert(s.branches == 5 && s.shared == 1 && s.leaves() == 50 - 15);
+
+    Grid overlay(8);
+    overlay.top().fill(SBox{2}, Tile{});
+    s = overlay.stats();
+    assert(s.branches == 2 && s.null == 14 && s.cubes == 1);
+}
+
+// copying from a view must give what painting there would have, grafting
+// aligned subtrees, and a copy turned and turned back must be the original
+void check_copy()
+{
+    Grid prefab(16);
+    paint::tree(View(prefab).clip(Box{ivec3(5, 11, 5)}));
+    for (ivec3 o: { ivec3(8, 0, 8), ivec3(3, 5, 7) }) {
+        Grid a = cleared_grid(32), b = cleared_grid(32);
+        for (Grid* g: { &a, &b })
+            g->top().fill(Box{ivec3(32, 6, 32)}, Tile{});
+        paint::tree(View(a).clip(o + Box{ivec3(5, 11, 5)}));
+        View(b).clip(o + Box{ivec3(5, 11, 5)})
+            .copy(View(prefab).translate(-o));
+        check_same(a, b);
+    }
+
+    Grid s = cleared_grid(32);
+    for (int i = 0; i < 100; i++) {
+        ivec3 p(coord(32), coord(32), coord(32));
+        if (coord(4))
+            s.top().fill(p + Box{ivec3(1 + coord(6))},
+                         Tile{}.color({coord(4), 0, 0}));
+        else
+            s.top().fill(p + SBox{1}, Tile{}.shape(boct{0x7f}));
+    }
+    auto voxels = [] (View v) {
+        std::map<std::tuple<int, int, int>, Tile> r;
+        v.each_tile([&] (SBox b, Tile t) {
+            for (auto p: (Box{b} & v.model_box()).coords())
+                r[std::make_tuple(p.x, p.y, p.z)] = t;
+        });
+        return r;
+    };
+    View from = View(s).clip(SBox{16} + ivec3(16)).center();
+    for (ivec3 o: { ivec3(0), ivec3(13, 2, 11) }) {
+        Grid t = cleared_grid(32), u = cleared_grid(32);
+        View turned = View(t).clip(SBox{16} + o).center()
+                             .rotate(irot::rotate_xyz(1) * irot::rotate_x(1));
+        turned.copy(from);
+        View back = View(u).clip(SBox{16} + ivec3(16)).center();
+        back.copy(turned);
+        auto vf = voxels(from), vt = voxels(turned);
+        assert(vf.size() == vt.size());
+        for (auto& v: vf)
+            assert(bool(vt.at(v.first).shape()) == bool(v.second.shape()));
+        assert(voxels(back) == vf);
+    }
+
+    // aligned subtrees of an unturned copy are shared
+    Grid c = cleared_grid(32);
+    View(c).clip(SBox{16}).copy(View(s).translate(ivec3(16)));
+    assert(c.stats().shared > 0);
+}
+
+// a lazily generated grid must hold only the chunks asked for, each as the
+// generator paints it, and all of them as painting the whole grid would
+void check_lazy()
+{
+    vector<pair<Box, Tile>> boxes;
+    for (int i = 0; i < 50; i++)
+        boxes.emplace_back(
+            ivec3(coord(64), coord(64), coord(64)) + Box{ivec3(1 + coord(20))},
+            Tile{}.color({coord(32), 0, 0}));
+    auto generator = [&] (View v) {
+        v.clip(Box{ivec3(64, 12, 64)}).fill(Tile{});
+        for (auto& bt: boxes)
+            v.clip(bt.first).fill(bt.second);
+    };
+
+    Grid whole(64, Tile::empty());
+    generator(View(whole));
+
+    Grid g(64);
+    g.generate_lazily(16, generator);
+    assert(g.is_lazy() && g.ctop().is_null());
+    Grid before = g.share();
+    uint64_t generation = g.changes().generation();
+
+    // two chunks, then nothing more for the same box
+    assert(g.generate(Box::ranged(ivec3(10, 20, 30), ivec3(20, 30, 31))) == 2);
+    assert(g.generate(Box::ranged(ivec3(10, 20, 30), ivec3(20, 30, 31))) == 0);
+    assert(g.changes().changed(generation, SBox{16} + ivec3(0, 16, 16)));
+    assert(!g.changes().changed(generation, SBox{16}));
+    assert(before.ctop().is_null());
+    g.ctop().each_tile(SBox{64}, [&] (SBox s, Tile t) {
+        assert(Box::ranged(ivec3(0, 16, 16), ivec3(32, 32, 32)).contains(s));
+        assert(whole.ctop().find_smallest(s).tile() == t);
+    });
+
+    assert(g.generate(SBox{64}) == 64 - 2);
+    assert(g.stats().null == 0);
+    check_same(g, whole);
+}
+
+// painting a shape block by block must give what testing each cell would,
+// both into a grid of one tile (built) and into one that isn't (edited)
+void check_shape()
+{
+    Shape s = ((Shape::sphere(ivec3(24), 20*20) |
+                Shape::box(Box::ranged(ivec3(4, 2, 20), ivec3(40, 9, 27)))) -
+               Shape::cylinder(ivec2(30, 26), 7*7)) &
+              Shape::box(Box::ranged(ivec3(0, 3, 0), ivec3(40, 40, 40)));
+    Tile t = Tile{}.color({3, 19, 0});
+
+    for (bool smooth: { false, true })
+        for (bool uniform: { false, true }) {
+            Grid a = cleared_grid(32), b = cleared_grid(32);
+            if (!uniform)
+                for (Grid* g: { &a, &b })
+                    g->top().fill(SBox{4}, Tile{});
+            View v = View(a).translate(ivec3(-3, 0, -1))
+                            .rotate(irot::rotate_xyz(1));
+            View w = View(b).translate(ivec3(-3, 0, -1))
+                            .rotate(irot::rotate_xyz(1));
+            if (smooth)
+                paint::shape_smooth(v, s, t);
+            else
+                paint::shape(v, s, t);
+
+            EditBatch batch;
+            for (auto u: w.model_box().coords()) {
+                if (!smooth) {
+                    if (s.contains(u * 2 + 1))
+                        w[u].fill(t, batch);
+                    continue;
+                }
+                boct corners{0};
+                for (auto c: ioct::all())
+                    corners[c] |= s.contains((u + ivec3(c.bvec3_cast())) * 2);
+                if (corners)
+                    w[u].fill(t.shape(corners), batch);
+            }
+            w.apply(batch);
+            check_same(a, b);
+        }
+}
+
+// the chunked heightmap must give exactly the heights of the reference, on
+// any number of threads, including a last chunk of rows that isn't full
+void check_heightmap()
+{
+    ivec2 size(40, 37);
+    auto reference = paint::rolling_hills_heightmap_reference(size, 30);
+    for (unsigned threads: { 1, 3, 0 }) {
+        split_threads = threads;
+        auto h = paint::rolling_hills_heightmap(size, 30);
+        for (auto p: Box{ivec3(size.x, 1, size.y)}.coords())
+            assert(h[p.xz()] == reference[p.xz()]);
+    }
+    split_threads = 0;
+}
+
 int
 main()
 {
+    check_fill();
+    check_packed();
+    check_snapshot();
+    check_deduplicate();
+    check_share();
+    check_journal();
+    check_raycast();
+    check_tiles();
+    check_summary();
+    check_split();
+    check_builder();
+    check_world();
+    check_overlay();
+    check_stats();
+    check_copy();
+    check_lazy();
+    check_shape();
+    check_heightmap();
+
     grid = Grid(4);
 
     View(grid).fill({});